@@ -3,17 +3,37 @@
  *
  *  Description:
  *      This is a basic Linux kernel pseudo character device driver.
- *      The driver implements open, close, read, write, and lseek operations.
+ *      The driver implements open, close, read and write operations on
+ *      top of a page backed FIFO (circular) buffer which can also be
+ *      mapped into user space.
  *      It can be used as a template for developing more complex
  *      character drivers.
  *
  *  Functionality:
- *      - Registers a character device with the kernel.
- *      - Implements open, release (close), read, write, and lseek operations.
+ *      - Registers nr_devices character devices (minors) with the kernel,
+ *        each one with its own FIFO, state and lock.
+ *      - Implements open, release (close), read and write operations on top
+ *        of read_iter / write_iter, so readv / writev, io_uring, splice and
+ *        sendfile take the same path.
+ *      - Writers append at the tail of the FIFO, readers consume from the head.
+ *      - read() blocks until data is present, write() blocks until there is
+ *        space, O_NONBLOCK returns -EAGAIN instead. poll() / epoll are supported.
+ *      - the readers and the writers never exclude each other, ops of the
+ *        same side are serialised by the per side mutex.
+ *      - device numbers, class, cdev and /dev nodes come from the shared
+ *        driver core (drv_core.ko, 05DriverCore), as do the per-cpu
+ *        statistics (ops, bytes, errors, log2 latency histogram) of every
+ *        file operation under /sys/class/pdevclass/pdev*/stats/.
+ *      - open / read / write / release tracepoints (char_device_trace.h),
+ *        debug prints are pr_debug (dynamic debug).
+ *      - mmap() exposes a header page (head / tail) followed by the FIFO pages,
+ *        see char_device.h for the layout. a zero length write() / read()
+ *        after updating tail / head through the mapping wakes the sleepers
+ *        of the other side.
  *
  *  Usage:
  *      - To compile: `make`
- *      - To load: `sudo insmod char_driver.ko`
+ *      - To load: `sudo insmod drv_core.ko && sudo insmod char_driver.ko [ring_size_kb=<64..16384>] [nr_devices=<1..16>]`
  *      - To create a device node: `sudo mknod /dev/simple_char c <major> 0`
  *      - To remove: `sudo rmmod char_driver`
  *
@@ -30,7 +50,25 @@
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
-
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/cache.h>
+#include <linux/atomic.h>
+#include <linux/uio.h>
+#include <linux/ktime.h>
+#include <linux/splice.h>
+
+#include "char_device.h"
+#include "drv_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "char_device_trace.h"
 
 /* meta information */
 MODULE_LICENSE("GPL");
@@ -39,198 +77,523 @@ MODULE_DESCRIPTION("This is a basic Linux kernel pseudo character device driver.
 
 #define MODULE_NAME "SINGLE_CHAR_DEVICE"
 
-/* lets create a memory buffer on which we will do operations */
-#define PSEUDO_DEVICE_MEMORY_BUFFER 512
-char pseudo_device_buffer[PSEUDO_DEVICE_MEMORY_BUFFER];
+/* lets create a page backed FIFO on which we will do operations */
+#define PSEUDO_DEVICE_RING_MIN_KB 64
+#define PSEUDO_DEVICE_RING_MAX_KB (16 * 1024)
+
+static unsigned int ring_size_kb = PSEUDO_DEVICE_RING_MIN_KB;
+module_param(ring_size_kb, uint, 0444);
+MODULE_PARM_DESC(ring_size_kb, "FIFO size in KiB (64..16384, rounded up to a power of two)");
+
+/* lets create as many devices (minors) as requested, /dev/pdev, /dev/pdev1, .. */
+#define PSEUDO_DEVICE_MAX_DEVICES 16
+
+static unsigned int nr_devices = 1;
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices, "number of independent /dev/pdev devices (1..16)");
+
+/*
+ * the FIFO is one vmalloc area: the header page (struct pdev_ring_header)
+ * followed by the data pages. head and tail live in the header page so that
+ * mmap() users and read()/write() users share the same indices. they are free
+ * running 32 bit byte counters, the position inside the buffer is
+ * (index & (size - 1)) and used bytes = tail - head.
+ *
+ * the header page is writable from user space, so the kernel keeps its own
+ * copy of the size and never trusts hdr->size.
+ */
+struct pseudo_device_ring
+{
+  void *base;
+  struct pdev_ring_header *hdr;
+  char *data;
+  u32 size;
+  wait_queue_head_t readq;   /*readers waiting for data*/
+  wait_queue_head_t writeq;  /*writers waiting for space*/
+};
+
+/*
+ * the readers and the writers of a FIFO never exclude each other (head and
+ * tail are published with release / acquire), only ops of the same side do.
+ * what counts is ops in flight, not open files: threads or forked children
+ * sharing one fd run concurrent ops on the same side as well, so every op
+ * takes the side mutex.
+ */
+struct pseudo_device_side
+{
+  struct mutex lock;                /*held by the op in flight on this side*/
+} ____cacheline_aligned_in_smp;
+
+/*
+ * one per minor, reached through file->private_data. every instance is a
+ * separate cache line aligned allocation so that independent pipelines never
+ * share a cache line.
+ */
+struct pseudo_device
+{
+  struct pseudo_device_ring ring;
+  struct pseudo_device_side reader;
+  struct pseudo_device_side writer;
+  struct drv_core_dev core;          /*minor, cdev, /dev node, statistics*/
+  unsigned int index;
+} ____cacheline_aligned_in_smp;
 
-/* lets store device number */
-dev_t device_number;
+static struct pseudo_device *pdevs[PSEUDO_DEVICE_MAX_DEVICES];
 
-/*cdev variable*/
-struct cdev pcdev;
+/* device numbers and class of the driver */
+static struct drv_core pdev_core;
 
 /*-------------------------------------------------------------------*/
 /*define global functions*/
-loff_t _lseek(struct file *pfile, loff_t off, int whence)
+/*
+ * @brief bytes currently stored in the FIFO, indices may be updated by mmap() users
+ */
+static u32 pring_used(struct pseudo_device_ring *pring)
 {
-  loff_t cursor;
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  u32 head = smp_load_acquire(&pring->hdr->head);
+  u32 tail = smp_load_acquire(&pring->hdr->tail);
+
+  /*treat corrupted indices (head ahead of tail) as full, _read_iter / _write_iter report them*/
+  return min(tail - head, pring->size);
+}
+
+/*
+ * @brief copy bytes from the head of the FIFO to the iterator (user buffers, pipe pages, ..)
+ * @return bytes consumed (0 when empty), negative errno otherwise
+ */
+static ssize_t pring_consume(struct pseudo_device_ring *pring, struct iov_iter *to)
+{
+  size_t count = iov_iter_count(to), copied;
+  u32 head, tail, used, off, chunk;
+
+  /*tail may be published by a _write_iter or mmap() producer, pair with its release*/
+  head = READ_ONCE(pring->hdr->head);
+  tail = smp_load_acquire(&pring->hdr->tail);
+  used = tail - head;
+  if(used > pring->size)
+  {
+    pr_err("%s: %s corrupted ring indices %u:%u.\n", MODULE_NAME, __func__, head, tail);
+    return -EIO;
+  }
+
+  /*consume at most what is available between head and tail*/
+  count = min_t(size_t, count, used);
+  off = head & (pring->size - 1);
+  chunk = min_t(u32, count, pring->size - off);
+
+  if(!count)
+    return 0;
 
-  switch(whence)
+  /*copy data out (never ever believe on user buffer), wrap around if needed*/
+  copied = copy_to_iter(pring->data + off, chunk, to);
+  if(copied == chunk && count > chunk)
+    copied += copy_to_iter(pring->data, count - chunk, to);
+
+  if(!copied)
   {
-    case SEEK_SET:
-      if((off > PSEUDO_DEVICE_MEMORY_BUFFER) || (off < 0)) return -EINVAL;
-      pfile->f_pos = off;
-      break;
-    case SEEK_CUR:
-      cursor = pfile->f_pos + off;
-      if((cursor > PSEUDO_DEVICE_MEMORY_BUFFER) || (cursor < 0)) return -EINVAL;
-      pfile->f_pos += off;
-      break;
-    case SEEK_END:
-      cursor = PSEUDO_DEVICE_MEMORY_BUFFER + off;
-      if((cursor > PSEUDO_DEVICE_MEMORY_BUFFER) || (cursor < 0)) return -EINVAL;
-      pfile->f_pos = PSEUDO_DEVICE_MEMORY_BUFFER + off;
-      break;
-    default:
-      return -EINVAL;
+    pr_err("%s: %s copy_to_iter failed.\n", MODULE_NAME, __func__);
+    return -EFAULT;
   }
 
-  return pfile->f_pos;
+  /*release the consumed bytes (only what really got copied) back to the producer*/
+  smp_store_release(&pring->hdr->head, head + (u32)copied);
+  return copied;
 }
 
-ssize_t _read(struct file *pfile, char __user *pbuff, size_t count, loff_t *poff)
+/*
+ * @brief copy bytes from the iterator (user buffers, pipe pages, ..) to the tail of the FIFO
+ * @return bytes produced (0 when full), negative errno otherwise
+ */
+static ssize_t pring_produce(struct pseudo_device_ring *pring, struct iov_iter *from)
 {
-  pr_info("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+  size_t count = iov_iter_count(from), copied;
+  u32 head, tail, used, off, chunk;
+
+  /*head may be published by a _read_iter or mmap() consumer, pair with its release*/
+  tail = READ_ONCE(pring->hdr->tail);
+  head = smp_load_acquire(&pring->hdr->head);
+  used = tail - head;
+  if(used > pring->size)
+  {
+    pr_err("%s: %s corrupted ring indices %u:%u.\n", MODULE_NAME, __func__, head, tail);
+    return -EIO;
+  }
+
+  /*append at most the free space between tail and head*/
+  count = min_t(size_t, count, pring->size - used);
+  off = tail & (pring->size - 1);
+  chunk = min_t(u32, count, pring->size - off);
+
+  if(!count)
+    return 0;
 
-  if(pbuff == NULL || poff == NULL)
+  /*copy data in (never ever believe on user buffer), wrap around if needed*/
+  copied = copy_from_iter(pring->data + off, chunk, from);
+  if(copied == chunk && count > chunk)
+    copied += copy_from_iter(pring->data, count - chunk, from);
+
+  if(!copied)
   {
-    pr_err("%s: %s invalid parameters.\n", MODULE_NAME, __func__);
-    return -EINVAL;
+    pr_err("%s: %s copy_from_iter failed.\n", MODULE_NAME, __func__);
+    return -EFAULT;
   }
 
-  if((*poff + count) > PSEUDO_DEVICE_MEMORY_BUFFER)
+  /*publish the new bytes (only what really got copied) to the consumer*/
+  smp_store_release(&pring->hdr->tail, tail + (u32)copied);
+  return copied;
+}
+
+/*
+ * @brief consume from the FIFO, sleeping while it is empty
+ * @return bytes read, negative errno otherwise
+ */
+static ssize_t pdev_read(struct pseudo_device *pdev, struct kiocb *iocb, struct iov_iter *to)
+{
+  struct file *pfile = iocb->ki_filp;
+  struct pseudo_device_ring *pring = &pdev->ring;
+  ssize_t ret;
+
+  /*zero length read: a consumer of the mapping published head, wake whoever waits for space*/
+  if(!iov_iter_count(to))
   {
-    count = PSEUDO_DEVICE_MEMORY_BUFFER - *poff;
+    if(wq_has_sleeper(&pring->writeq))
+      wake_up_interruptible(&pring->writeq);
+    return 0;
   }
 
-  /*copy data to user (never ever believe on user buffer)*/
-  if(copy_to_user(pbuff, pseudo_device_buffer + *poff, count))
+  do
   {
-    pr_err("%s: %s copy_to_user failed.\n", MODULE_NAME, __func__);
-    return -EFAULT;
+    /*sleep until a writer published some data*/
+    if(pring_used(pring) == 0)
+    {
+      if((pfile->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT))
+        return -EAGAIN;
+
+      if(wait_event_interruptible(pring->readq, pring_used(pring) != 0))
+        return -ERESTARTSYS;
+    }
+
+    /*another reader may have emptied the FIFO meanwhile, then wait again*/
+    mutex_lock(&pdev->reader.lock);
+    ret = pring_consume(pring, to);
+    mutex_unlock(&pdev->reader.lock);
+  } while(ret == 0);
+
+  /*there is space now, let the writers in (wq_has_sleeper orders against their check)*/
+  if(ret > 0 && wq_has_sleeper(&pring->writeq))
+    wake_up_interruptible(&pring->writeq);
+
+  return ret;
+}
+
+/*
+ * @brief append to the FIFO, sleeping while it is full
+ * @return bytes written, negative errno otherwise
+ */
+static ssize_t pdev_write(struct pseudo_device *pdev, struct kiocb *iocb, struct iov_iter *from)
+{
+  struct file *pfile = iocb->ki_filp;
+  struct pseudo_device_ring *pring = &pdev->ring;
+  ssize_t ret;
+
+  /*zero length write: a producer of the mapping published tail, wake whoever waits for data*/
+  if(!iov_iter_count(from))
+  {
+    if(wq_has_sleeper(&pring->readq))
+      wake_up_interruptible(&pring->readq);
+    return 0;
   }
 
-  /*update the current file position and return count*/
-  *poff += count;
-  return count;
+  do
+  {
+    /*sleep until a reader made some space*/
+    if(pring_used(pring) == pring->size)
+    {
+      if((pfile->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT))
+        return -EAGAIN;
+
+      if(wait_event_interruptible(pring->writeq, pring_used(pring) != pring->size))
+        return -ERESTARTSYS;
+    }
+
+    /*another writer may have filled the FIFO meanwhile, then wait again*/
+    mutex_lock(&pdev->writer.lock);
+    ret = pring_produce(pring, from);
+    mutex_unlock(&pdev->writer.lock);
+  } while(ret == 0);
+
+  /*there is data now, let the readers in (wq_has_sleeper orders against their check)*/
+  if(ret > 0 && wq_has_sleeper(&pring->readq))
+    wake_up_interruptible(&pring->readq);
+
+  return ret;
 }
 
-ssize_t _write(struct file *pfile, const char __user *pbuff, size_t count, loff_t *poff)
+ssize_t _read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-  pr_info("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+  struct pseudo_device *pdev = iocb->ki_filp->private_data;
+  size_t count = iov_iter_count(to);
+  u64 start, latency;
+  ssize_t ret;
+
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
 
-  if(pbuff == NULL || poff == NULL)
+  if(pdev == NULL)
   {
     pr_err("%s: %s invalid parameters.\n", MODULE_NAME, __func__);
     return -EINVAL;
   }
 
-  if((*poff + count) > PSEUDO_DEVICE_MEMORY_BUFFER)
-  {
-    count = PSEUDO_DEVICE_MEMORY_BUFFER - *poff;
-  }
+  start = ktime_get_ns();
+  ret = pdev_read(pdev, iocb, to);
+  latency = ktime_get_ns() - start;
 
-  if(!count)
+  drv_core_account(&pdev->core, DRV_STAT_READ, ret, latency);
+  trace_pdev_read(pdev->index, count, ret, READ_ONCE(pdev->ring.hdr->head), latency);
+  return ret;
+}
+
+ssize_t _write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+  struct pseudo_device *pdev = iocb->ki_filp->private_data;
+  size_t count = iov_iter_count(from);
+  u64 start, latency;
+  ssize_t ret;
+
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+
+  if(pdev == NULL)
   {
-    pr_err("%s: %s buffer full. no space available.\n", MODULE_NAME, __func__);
-    return -ENOMEM;
+    pr_err("%s: %s invalid parameters.\n", MODULE_NAME, __func__);
+    return -EINVAL;
   }
 
-  /*copy data to user (never ever believe on user buffer)*/
-  if(copy_from_user(pseudo_device_buffer + *poff, pbuff, count))
+  start = ktime_get_ns();
+  ret = pdev_write(pdev, iocb, from);
+  latency = ktime_get_ns() - start;
+
+  drv_core_account(&pdev->core, DRV_STAT_WRITE, ret, latency);
+  trace_pdev_write(pdev->index, count, ret, READ_ONCE(pdev->ring.hdr->tail), latency);
+  return ret;
+}
+
+__poll_t _poll(struct file *pfile, poll_table *wait)
+{
+  struct pseudo_device_ring *pring = &((struct pseudo_device *)pfile->private_data)->ring;
+  __poll_t mask = 0;
+  u32 used;
+
+  poll_wait(pfile, &pring->readq, wait);
+  poll_wait(pfile, &pring->writeq, wait);
+
+  used = pring_used(pring);
+  if(used != 0)
+    mask |= EPOLLIN | EPOLLRDNORM;
+  if(used != pring->size)
+    mask |= EPOLLOUT | EPOLLWRNORM;
+
+  return mask;
+}
+
+int _mmap(struct file *pfile, struct vm_area_struct *vma)
+{
+  struct pseudo_device_ring *pring = &((struct pseudo_device *)pfile->private_data)->ring;
+
+  pr_debug("%s: executing %s, requested %lu bytes\n", MODULE_NAME, __func__,
+                                                   vma->vm_end - vma->vm_start);
+
+  /*header page + data pages, shared with every other user of the device*/
+  if(!(vma->vm_flags & VM_SHARED))
   {
-    pr_err("%s: %s copy_to_user failed.\n", MODULE_NAME, __func__);
-    return -EFAULT;
+    pr_err("%s: %s only MAP_SHARED is supported.\n", MODULE_NAME, __func__);
+    return -EINVAL;
   }
 
-  /*update the current file position and return count*/
-  *poff += count;
-  return count;
+  /*remap_vmalloc_range() rejects offsets / lengths outside the FIFO*/
+  return remap_vmalloc_range(vma, pring->base, vma->vm_pgoff);
 }
 
 int _open(struct inode *node, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
-  return 0;
+  struct pseudo_device *pdev;
+  u64 start = ktime_get_ns();
+  int ret;
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+
+  /*every minor has its own context, hand it to the other file operations*/
+  pdev = container_of(node->i_cdev, struct pseudo_device, core.cdev);
+  pfile->private_data = pdev;
+
+  /*FIFO has no file position*/
+  ret = stream_open(node, pfile);
+
+  drv_core_account(&pdev->core, DRV_STAT_OPEN, ret, ktime_get_ns() - start);
+  trace_pdev_open(pdev->index, pfile->f_mode, pfile->f_flags, ret);
+  return ret;
 }
 
 int _release(struct inode *pnode, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  struct pseudo_device *pdev = pfile->private_data;
+  u64 start = ktime_get_ns();
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+  trace_pdev_release(pdev->index);
+
+  drv_core_account(&pdev->core, DRV_STAT_RELEASE, 0, ktime_get_ns() - start);
   return 0;
 }
 
 /*file operations of the driver*/
 struct file_operations pcfops =
 {
-  .open    = _open,
-  .write   = _write,
-  .read    = _read,
-  .llseek  = _lseek,
-  .release = _release,
-  .owner   = THIS_MODULE
+  .open         = _open,
+  .write_iter   = _write_iter,
+  .read_iter    = _read_iter,
+  .splice_read  = generic_file_splice_read,
+  .splice_write = iter_file_splice_write,
+  .mmap         = _mmap,
+  .poll         = _poll,
+  .llseek       = no_llseek,
+  .release      = _release,
+  .owner        = THIS_MODULE
 };
 
-struct class *pdclass;
-
-struct device *pdevice;
+static const struct attribute_group *pdev_groups[] =
+{
+  &drv_core_stats_group,
+  NULL
+};
 
 /*-------------------------------------------------------------------*/
 /*define static functions*/
 /*
- * @brief this function is called, when the module is loaded into the kernel
+ * @brief allocate the FIFO of one device (header page + data pages, zeroed)
+ * @return 0 when OK, negative errno otherwise
  */
-static int __init ModuleCharacterDeviceInit(void)
+static int pring_init(struct pseudo_device_ring *pring, u32 size)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  pring->base = vmalloc_user(PDEV_RING_HEADER_SIZE + size);
+  if(pring->base == NULL)
+    return -ENOMEM;
 
-  /*1. dynamically allocate a device number (creates device number)*/
-  if(alloc_chrdev_region(&device_number, 0 /*first minor*/, 1 /*counts*/, "pdevice") < 0)
-  {
-    pr_err("%s: %s Failed to allocate a major number\n", MODULE_NAME, __func__);
-    return -1;
-  }
+  pring->size = size;
+  pring->hdr = pring->base;
+  pring->data = (char *)pring->base + PDEV_RING_HEADER_SIZE;
+  pring->hdr->size = size;
+  pring->hdr->data_offset = PDEV_RING_HEADER_SIZE;
+  init_waitqueue_head(&pring->readq);
+  init_waitqueue_head(&pring->writeq);
+  return 0;
+}
 
-  pr_info("%s: %s device number <major>:<minor> = %d:%d\n", MODULE_NAME, __func__,
-                                                      MAJOR(device_number),
-                                                      MINOR(device_number));
-
-  /*
-    - The Virtual Filesystem (also known as Virtual Filesystem Switch or VFS) is a
-      kernel software layer that handles all system calls related to a standard Unix
-      filesystem. Its main strength is providing a common interface to several kinds
-      of filesystems.
-
-    - The Virtual File System (VFS) layer [1] provides a uniform interface for the
-      kernel to deal with various I/O requests and specifies a standard interface
-      that each file system must support.
-  */
- 
-  /*2. create device class under /sys/class/ */
-  pdclass = class_create(THIS_MODULE, "pdevclass");
-  if (IS_ERR(pdclass))
+/*
+ * @brief init the lock of one side of the FIFO
+ */
+static void pside_init(struct pseudo_device_side *side)
+{
+  mutex_init(&side->lock);
+}
+
+/*
+ * @brief free one minor with the last reference of its node
+ */
+static void pdev_release(struct drv_core_dev *cd)
+{
+  struct pseudo_device *pdev = container_of(cd, struct pseudo_device, core);
+
+  vfree(pdev->ring.base);
+  kfree(pdev);
+}
+
+/*
+ * @brief create one minor: FIFO, then statistics, cdev and /dev node
+ * @return device context, ERR_PTR otherwise
+ */
+static struct pseudo_device *pdev_create(unsigned int index, u32 size)
+{
+  struct pseudo_device *pdev;
+  int ret;
+
+  pdev = kzalloc(sizeof(*pdev), GFP_KERNEL);
+  if(pdev == NULL)
+    return ERR_PTR(-ENOMEM);
+
+  pdev->index = index;
+
+  pside_init(&pdev->reader);
+  pside_init(&pdev->writer);
+
+  ret = pring_init(&pdev->ring, size);
+  if(ret)
   {
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to register device class\n", MODULE_NAME, __func__);
-    return PTR_ERR(pdclass);
+    pr_err("%s: %s Failed to allocate %u bytes FIFO for minor %u\n", MODULE_NAME, __func__, size, index);
+    goto err_free;
   }
 
-  /*3. Create the device file in /dev and set the permissions to 0666 */
-  pdevice = device_create(pdclass, NULL, device_number, NULL, "pdev");
-  if(pdevice == NULL)
+  /*minors are handed out in order, the first one keeps the historical name*/
+  pdev->core.release = pdev_release;
+  ret = index ? drv_core_dev_add(&pdev_core, &pdev->core, &pcfops, NULL, pdev, pdev_groups, "pdev%u", index)
+              : drv_core_dev_add(&pdev_core, &pdev->core, &pcfops, NULL, pdev, pdev_groups, "pdev");
+  if(ret)
   {
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
-    return -1;
+    /*the node took pdev along*/
+    pr_err("%s: %s Failed to create the device for minor %u\n", MODULE_NAME, __func__, index);
+    return ERR_PTR(ret);
   }
 
-  /*4. Initialize the character device and add it to the system*/
-  cdev_init(&pcdev, &pcfops);
-  pcdev.owner = THIS_MODULE;
+  return pdev;
 
-  /*5. register a device (cdev structure) with VFS*/  
-  if(cdev_add(&pcdev, device_number, 1) < 0)
+err_free:
+  kfree(pdev);
+  return ERR_PTR(ret);
+}
+
+/*
+ * @brief remove one minor created by pdev_create, pdev_release frees it
+ */
+static void pdev_destroy(struct pseudo_device *pdev)
+{
+  drv_core_dev_del(&pdev->core);
+}
+
+/*
+ * @brief this function is called, when the module is loaded into the kernel
+ */
+static int __init ModuleCharacterDeviceInit(void)
+{
+  unsigned int i;
+  u32 size;
+  int ret;
+
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+
+  ring_size_kb = clamp_t(unsigned int, ring_size_kb, PSEUDO_DEVICE_RING_MIN_KB, PSEUDO_DEVICE_RING_MAX_KB);
+  nr_devices = clamp_t(unsigned int, nr_devices, 1, PSEUDO_DEVICE_MAX_DEVICES);
+  size = roundup_pow_of_two(ring_size_kb * 1024);
+
+  /*1. device numbers and /sys/class/pdevclass/ from the driver core*/
+  ret = drv_core_register(&pdev_core, THIS_MODULE, "pdevclass", nr_devices);
+  if(ret)
+    return ret;
+
+  /*2. create FIFO, cdev and /dev node of every minor*/
+  for(i = 0; i < nr_devices; i++)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to add the cdev\n", MODULE_NAME, __func__);
-    return -1;
+    pdevs[i] = pdev_create(i, size);
+    if(IS_ERR(pdevs[i]))
+    {
+      ret = PTR_ERR(pdevs[i]);
+
+      while(i--)
+        pdev_destroy(pdevs[i]);
+      drv_core_unregister(&pdev_core);
+      return ret;
+    }
   }
 
-  pr_info("%s: %s device created successfully..\n", MODULE_NAME, __func__);
+  pr_info("%s: %s device created successfully.. (%u x FIFO %u bytes)\n", MODULE_NAME, __func__, nr_devices, size);
   return 0;
 }
 
@@ -239,13 +602,14 @@ static int __init ModuleCharacterDeviceInit(void)
  */
 static void __exit ModuleCharacterDeviceExit(void)
 {
+  unsigned int i;
+
   pr_info("%s: executing %s\n", MODULE_NAME, __func__);
   
   /*cleanup task*/
-  device_destroy(pdclass, device_number);
-  class_destroy(pdclass);
-  cdev_del(&pcdev);
-  unregister_chrdev_region(device_number, 1);
+  for(i = 0; i < nr_devices; i++)
+    pdev_destroy(pdevs[i]);
+  drv_core_unregister(&pdev_core);
 
   pr_info("%s: %s device cleaned up successfully..\n", MODULE_NAME, __func__);
 }
@@ -0,0 +1,57 @@
+/************************************************************
+ *  char_device.h - Shared definitions of /dev/pdev
+ *
+ *  Description:
+ *      Layout of the memory exposed by mmap() on /dev/pdev.
+ *      This header is included by the driver and by user space.
+ *
+ *      offset 0           : struct pdev_ring_header (one page)
+ *      offset data_offset : FIFO data (size bytes)
+ *
+ *      head and tail are free running byte counters, the position
+ *      inside the data area is (index & (size - 1)).
+ *      A producer fills data at tail and then publishes tail with a
+ *      store-release. A consumer reads tail with a load-acquire,
+ *      consumes the data and then publishes head with a store-release.
+ *
+ *      The kernel does not watch the mapping: blocking read() / write()
+ *      and poll() on the other side only wake up when told. A producer
+ *      of the mapping does a zero length write() after publishing tail,
+ *      a consumer a zero length read() after publishing head, whenever
+ *      the other side may sleep (e.g. once per batch). Mappers on both
+ *      sides which only spin on the indices need no notification.
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#ifndef CHAR_DEVICE_H
+#define CHAR_DEVICE_H
+
+#include <linux/types.h>
+
+/*
+ * head and tail sit on their own cache lines (64 bytes on the Cortex-A53) so
+ * that a producer and a consumer running on different cores never write to
+ * the same line.
+ */
+#define PDEV_RING_CACHELINE 64
+
+struct pdev_ring_header
+{
+  __u32 head;         /*consumer index*/
+  __u8  pad0[PDEV_RING_CACHELINE - sizeof(__u32)];
+  __u32 tail;         /*producer index*/
+  __u8  pad1[PDEV_RING_CACHELINE - sizeof(__u32)];
+  __u32 size;         /*size of the data area, power of two*/
+  __u32 data_offset;  /*offset of the data area in the mapping*/
+};
+
+#ifdef __KERNEL__
+#define PDEV_RING_HEADER_SIZE PAGE_SIZE
+#endif
+
+#endif /* CHAR_DEVICE_H */
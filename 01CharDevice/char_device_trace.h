@@ -0,0 +1,116 @@
+/************************************************************
+ *  char_device_trace.h - Tracepoints of /dev/pdev
+ *
+ *  Description:
+ *      open / read / write / release tracepoints of the pseudo
+ *      character driver. They cost a static branch when disabled.
+ *
+ *  Usage:
+ *      - trace-cmd record -e char_device
+ *      - perf record -e 'char_device:*'
+ *      - echo 1 > /sys/kernel/tracing/events/char_device/enable
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM char_device
+
+#if !defined(_CHAR_DEVICE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _CHAR_DEVICE_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pdev_open,
+
+  TP_PROTO(unsigned int minor, fmode_t mode, unsigned int flags, int ret),
+
+  TP_ARGS(minor, mode, flags, ret),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, minor)
+    __field(unsigned int, mode)
+    __field(unsigned int, flags)
+    __field(int, ret)
+  ),
+
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->mode = (__force unsigned int)mode;
+    __entry->flags = flags;
+    __entry->ret = ret;
+  ),
+
+  TP_printk("minor=%u mode=%s%s flags=0x%x ret=%d", __entry->minor,
+            __entry->mode & (__force unsigned int)FMODE_READ ? "r" : "",
+            __entry->mode & (__force unsigned int)FMODE_WRITE ? "w" : "",
+            __entry->flags, __entry->ret)
+);
+
+TRACE_EVENT(pdev_release,
+
+  TP_PROTO(unsigned int minor),
+
+  TP_ARGS(minor),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, minor)
+  ),
+
+  TP_fast_assign(
+    __entry->minor = minor;
+  ),
+
+  TP_printk("minor=%u", __entry->minor)
+);
+
+/* read and write share the layout: index is the FIFO head (read) or tail (write) after the op */
+DECLARE_EVENT_CLASS(pdev_io,
+
+  TP_PROTO(unsigned int minor, size_t requested, ssize_t ret, u32 index, u64 latency_ns),
+
+  TP_ARGS(minor, requested, ret, index, latency_ns),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, minor)
+    __field(size_t, requested)
+    __field(ssize_t, ret)
+    __field(u32, index)
+    __field(u64, latency_ns)
+  ),
+
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->requested = requested;
+    __entry->ret = ret;
+    __entry->index = index;
+    __entry->latency_ns = latency_ns;
+  ),
+
+  TP_printk("minor=%u requested=%zu ret=%zd index=%u latency_ns=%llu",
+            __entry->minor, __entry->requested, __entry->ret,
+            __entry->index, __entry->latency_ns)
+);
+
+DEFINE_EVENT(pdev_io, pdev_read,
+  TP_PROTO(unsigned int minor, size_t requested, ssize_t ret, u32 index, u64 latency_ns),
+  TP_ARGS(minor, requested, ret, index, latency_ns)
+);
+
+DEFINE_EVENT(pdev_io, pdev_write,
+  TP_PROTO(unsigned int minor, size_t requested, ssize_t ret, u32 index, u64 latency_ns),
+  TP_ARGS(minor, requested, ret, index, latency_ns)
+);
+
+#endif /* _CHAR_DEVICE_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE char_device_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+
+#include "../char_device.h"
+
+#define DEVICE_PATH "/dev/pdev"
+#define CHUNK_SIZE (64 * 1024)               // Bytes per read()/write() or per mmap copy
+#define TOTAL_BYTES (256UL * 1024 * 1024)    // Bytes moved per benchmark
+#define SMALL_CHUNK_SIZE 64                  // Bytes per op for the per-op latency run
+#define SHARED_THREADS 2                     // Threads per side sharing one fd
+#define SHARED_BYTES (32UL * 1024 * 1024)    // Bytes moved by the shared fd check
+
+static char src[CHUNK_SIZE];
+static char dst[CHUNK_SIZE];
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Throw away whatever a previous user left in the FIFO
+static void drain(void) {
+    int fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    if (fd == -1)
+        return;
+    while (read(fd, dst, sizeof(dst)) > 0)
+        ;
+    close(fd);
+}
+
+// Data paths exercised by the read/write style benchmarks
+enum bench_path {
+    PATH_RW,      // read() / write()
+    PATH_RWV,     // readv() / writev() with IOV_COUNT buffers
+    PATH_SPLICE,  // splice() device -> pipe -> /dev/null, vmsplice() + splice() pipe -> device
+};
+
+static const char *path_name[] = { "read/write", "readv/writev", "splice" };
+
+#define IOV_COUNT 4
+
+static void fill_iov(struct iovec *iov, char *buf, size_t chunk) {
+    for (int i = 0; i < IOV_COUNT; i++) {
+        iov[i].iov_base = buf + i * (chunk / IOV_COUNT);
+        iov[i].iov_len = chunk / IOV_COUNT;
+    }
+}
+
+static void consumer_rw(enum bench_path path, size_t chunk) {
+    struct iovec iov[IOV_COUNT];
+    int pipefd[2], null_fd = -1;
+    size_t done = 0;
+    int fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd == -1) {
+        perror("consumer: failed to open " DEVICE_PATH);
+        exit(EXIT_FAILURE);
+    }
+    fill_iov(iov, dst, chunk);
+    if (path == PATH_SPLICE) {
+        null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd == -1 || pipe(pipefd) == -1) {
+            perror("consumer: failed to set up splice");
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (done < TOTAL_BYTES) {
+        ssize_t n;
+        switch (path) {
+        case PATH_RWV:
+            n = readv(fd, iov, IOV_COUNT);
+            break;
+        case PATH_SPLICE:
+            n = splice(fd, NULL, pipefd[1], NULL, chunk, SPLICE_F_MOVE);
+            if (n > 0 && splice(pipefd[0], NULL, null_fd, NULL, n, SPLICE_F_MOVE) != n)
+                n = -1;
+            break;
+        default:
+            n = read(fd, dst, chunk);
+            break;
+        }
+        if (n == -1) {
+            perror("consumer: read");
+            exit(EXIT_FAILURE);
+        }
+        done += n;
+    }
+    close(fd);
+    exit(EXIT_SUCCESS);
+}
+
+static int producer_rw(enum bench_path path, size_t chunk) {
+    struct iovec iov[IOV_COUNT];
+    int pipefd[2];
+    size_t done = 0;
+    int fd = open(DEVICE_PATH, O_WRONLY);
+    if (fd == -1) {
+        perror("producer: failed to open " DEVICE_PATH);
+        return -1;
+    }
+    fill_iov(iov, src, chunk);
+    if (path == PATH_SPLICE && pipe(pipefd) == -1) {
+        perror("producer: failed to set up splice");
+        close(fd);
+        return -1;
+    }
+    while (done < TOTAL_BYTES) {
+        ssize_t n;
+        switch (path) {
+        case PATH_RWV:
+            n = writev(fd, iov, IOV_COUNT);
+            break;
+        case PATH_SPLICE: {
+            // Hand the user pages to the pipe, then move them all into the device
+            struct iovec one = { src, chunk };
+            ssize_t left = vmsplice(pipefd[1], &one, 1, 0);
+            n = left;
+            while (left > 0) {
+                ssize_t m = splice(pipefd[0], NULL, fd, NULL, left, SPLICE_F_MOVE);
+                if (m == -1) {
+                    n = -1;
+                    break;
+                }
+                left -= m;
+            }
+            break;
+        }
+        default:
+            n = write(fd, src, chunk);
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("producer: write");
+            break;
+        }
+        done += n;
+    }
+    if (path == PATH_SPLICE) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    close(fd);
+    return done < TOTAL_BYTES ? -1 : 0;
+}
+
+static void consumer_mmap(volatile struct pdev_ring_header *hdr, char *data) {
+    size_t done = 0;
+    uint32_t mask = hdr->size - 1;
+    while (done < TOTAL_BYTES) {
+        uint32_t head = hdr->head;
+        uint32_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+        uint32_t n = tail - head, off = head & mask;
+        if (n == 0)
+            continue;
+        if (n > CHUNK_SIZE)
+            n = CHUNK_SIZE;
+        if (n > mask + 1 - off)
+            n = mask + 1 - off;
+        memcpy(dst, data + off, n);
+        __atomic_store_n(&hdr->head, head + n, __ATOMIC_RELEASE);
+        done += n;
+    }
+    exit(EXIT_SUCCESS);
+}
+
+static void producer_mmap(volatile struct pdev_ring_header *hdr, char *data) {
+    size_t done = 0;
+    uint32_t mask = hdr->size - 1;
+    while (done < TOTAL_BYTES) {
+        uint32_t tail = hdr->tail;
+        uint32_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        uint32_t n = mask + 1 - (tail - head), off = tail & mask;
+        if (n == 0)
+            continue;
+        if (n > CHUNK_SIZE)
+            n = CHUNK_SIZE;
+        if (n > mask + 1 - off)
+            n = mask + 1 - off;
+        memcpy(data + off, src, n);
+        __atomic_store_n(&hdr->tail, tail + n, __ATOMIC_RELEASE);
+        done += n;
+    }
+}
+
+// Stop a consumer whose producer gave up, it would wait for the missing bytes forever
+static void stop_child(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static void report(const char *name, size_t chunk, double seconds) {
+    printf("%-12s %6zu B/op %8.1f MB/s %8.1f ns/op (%lu MiB in %.3f s)\n", name, chunk,
+           TOTAL_BYTES / seconds / 1e6, seconds * 1e9 / (TOTAL_BYTES / chunk),
+           TOTAL_BYTES >> 20, seconds);
+}
+
+static int bench_rw(enum bench_path path, size_t chunk) {
+    double start;
+    pid_t pid;
+    int status;
+
+    drain();
+    start = now_sec();
+    pid = fork();
+    if (pid == 0)
+        consumer_rw(path, chunk);
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (producer_rw(path, chunk) == -1) {
+        stop_child(pid);
+        return -1;
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+    report(path_name[path], chunk, now_sec() - start);
+    return 0;
+}
+
+static int bench_mmap(void) {
+    struct pdev_ring_header hdr;
+    size_t map_len;
+    char *map;
+    double start;
+    pid_t pid;
+    int fd, status;
+
+    drain();
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open " DEVICE_PATH);
+        return -1;
+    }
+
+    // Map the header page first to learn the size of the FIFO
+    map = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to mmap " DEVICE_PATH " header");
+        close(fd);
+        return -1;
+    }
+    memcpy(&hdr, map, sizeof(hdr));
+    munmap(map, sysconf(_SC_PAGESIZE));
+
+    map_len = hdr.data_offset + hdr.size;
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to mmap " DEVICE_PATH);
+        close(fd);
+        return -1;
+    }
+
+    start = now_sec();
+    pid = fork();
+    if (pid == 0)
+        consumer_mmap((struct pdev_ring_header *)map, map + hdr.data_offset);
+    if (pid == -1) {
+        perror("fork");
+        munmap(map, map_len);
+        close(fd);
+        return -1;
+    }
+    producer_mmap((struct pdev_ring_header *)map, map + hdr.data_offset);
+    waitpid(pid, &status, 0);
+    munmap(map, map_len);
+    close(fd);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+    report("mmap", CHUNK_SIZE, now_sec() - start);
+    return 0;
+}
+
+// Two producer threads on one write fd, two consumer threads on one read fd: every op of a side
+// overlaps with the other thread's, so bytes delivered twice or lost show up in the totals
+struct shared_fd {
+    int rfd, wfd;
+    atomic_size_t produced, consumed, corrupt;
+    atomic_int producers_done;
+};
+
+static void *shared_producer(void *arg) {
+    struct shared_fd *s = arg;
+    size_t done = 0;
+    while (done < SHARED_BYTES / SHARED_THREADS) {
+        ssize_t n = write(s->wfd, src, SMALL_CHUNK_SIZE);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("shared producer: write");
+            break;
+        }
+        done += n;
+    }
+    atomic_fetch_add(&s->produced, done);
+    atomic_fetch_add(&s->producers_done, 1);
+    return NULL;
+}
+
+static void *shared_consumer(void *arg) {
+    struct shared_fd *s = arg;
+    char buf[SMALL_CHUNK_SIZE];
+    for (;;) {
+        // Seen before the read, so an empty FIFO after it means everything was consumed
+        int finished = atomic_load(&s->producers_done) == SHARED_THREADS;
+        ssize_t n = read(s->rfd, buf, sizeof(buf));
+        if (n == -1 && errno == EAGAIN) {
+            if (finished)
+                return NULL;
+            sched_yield();
+            continue;
+        }
+        if (n == -1) {
+            perror("shared consumer: read");
+            return NULL;
+        }
+        for (ssize_t i = 0; i < n; i++)
+            if (buf[i] != src[0])
+                atomic_fetch_add(&s->corrupt, 1);
+        atomic_fetch_add(&s->consumed, n);
+    }
+}
+
+static int bench_shared_fd(void) {
+    pthread_t producer[SHARED_THREADS], consumer[SHARED_THREADS];
+    struct shared_fd s = { 0 };
+    double start;
+
+    drain();
+    s.rfd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    s.wfd = open(DEVICE_PATH, O_WRONLY);
+    if (s.rfd == -1 || s.wfd == -1) {
+        perror("Failed to open " DEVICE_PATH);
+        if (s.rfd != -1)
+            close(s.rfd);
+        if (s.wfd != -1)
+            close(s.wfd);
+        return -1;
+    }
+
+    start = now_sec();
+    for (int i = 0; i < SHARED_THREADS; i++) {
+        pthread_create(&consumer[i], NULL, shared_consumer, &s);
+        pthread_create(&producer[i], NULL, shared_producer, &s);
+    }
+    for (int i = 0; i < SHARED_THREADS; i++) {
+        pthread_join(producer[i], NULL);
+        pthread_join(consumer[i], NULL);
+    }
+
+    printf("%-12s %6d B/op %8.1f MB/s, %zu bytes written, %zu read, %zu corrupt\n", "shared fd",
+           SMALL_CHUNK_SIZE, atomic_load(&s.consumed) / (now_sec() - start) / 1e6,
+           atomic_load(&s.produced), atomic_load(&s.consumed), atomic_load(&s.corrupt));
+
+    close(s.rfd);
+    close(s.wfd);
+    if (atomic_load(&s.produced) != SHARED_BYTES || atomic_load(&s.consumed) != SHARED_BYTES ||
+        atomic_load(&s.corrupt)) {
+        fprintf(stderr, "shared fd: bytes lost, duplicated or corrupted\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    memset(src, 0xa5, sizeof(src));
+
+    // Large ops show throughput, small ops show the per-op (locking) cost
+    if (bench_rw(PATH_RW, CHUNK_SIZE) == -1 || bench_rw(PATH_RW, SMALL_CHUNK_SIZE) == -1 ||
+        bench_rw(PATH_RWV, CHUNK_SIZE) == -1 || bench_rw(PATH_SPLICE, CHUNK_SIZE) == -1 ||
+        bench_mmap() == -1 || bench_shared_fd() == -1) {
+        fprintf(stderr, "benchmark failed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
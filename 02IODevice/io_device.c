@@ -10,10 +10,36 @@
  *  Functionality:
  *      - Registers a character device (io) with the kernel.
  *      - Implements write with turn on / off / toggle feature
+ *      - read() returns the levels of all pins as one __u32 (bit n = pins[n]),
+ *        or, after PIO_IOC_EDGE_WATCH, the timestamped edges of the input
+ *        pins (PIO_IOC_SET_INPUT) as struct pio_edge_event records.
+ *      - drives the GPIOs of the `pins` module parameter (default GPIO 4,
+ *        the LED), bit n of every mask is pins[n].
+ *      - one write() carries a whole command stream which is executed in
+ *        one kernel pass:
+ *          '0' / '1'  set the selected pins off / on
+ *          'T'        toggle the selected pins
+ *          'p<hex>'   select the pins the next commands act on (all after open)
+ *          'u<n>'     wait n microseconds (n <= 1000000)
+ *          'm<n>'     wait n milliseconds (n <= 10000)
+ *          whitespace and ',' are ignored
+ *        e.g. `echo "1 m500 0 m500 T u20 T" > /dev/pio`
+ *      - PIO_IOC_SET_MASK sets / clears a mask of pins in one call,
+ *        PIO_IOC_GET_LEVELS returns the driven levels (io_device.h).
+ *      - PIO_IOC_WAVE_START plays a timed edge list (e.g. PWM) from an
+ *        hrtimer, no syscall per edge. The waveform keeps running after
+ *        close() until PIO_IOC_WAVE_STOP, a new waveform or rmmod.
+ *      - device number, class, cdev and /dev/pio come from the shared
+ *        driver core (drv_core.ko, 05DriverCore), as do the per-cpu
+ *        statistics (ops, bytes, errors, log2 latency histogram) of every
+ *        file operation under /sys/class/iodevclass/pio/stats/.
+ *      - open / write / release tracepoints (io_device_trace.h),
+ *        debug prints are pr_debug (dynamic debug).
  *
  *  Usage:
  *      - To compile: `make`
- *      - To load: `sudo insmod io_driver.ko`
+ *      - To load: `sudo insmod drv_core.ko`, then `sudo insmod io_driver.ko`
+ *        or `sudo insmod io_driver.ko pins=4,17,27`
  *      - To remove: `sudo rmmod io_driver`
  *
  *  License:
@@ -30,6 +56,26 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/bitops.h>
+#include <linux/slab.h>
+#include <linux/ctype.h>
+#include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/sched/signal.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+
+#include "io_device.h"
+#include "drv_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "io_device_trace.h"
 
 /* meta information */
 MODULE_LICENSE("GPL");
@@ -38,18 +84,561 @@ MODULE_DESCRIPTION("This is a basic Linux kernel character device driver for io
 
 #define MODULE_NAME "SINGLE_CHAR_IO_DEVICE"
 
-/* lets store device number */
-dev_t device_number;
+/* device number, class and /dev/pio from the driver core */
+static struct drv_core pio_core;
+/*allocated at load, freed by pio_release with the last reference of the node*/
+static struct drv_core_dev *pio_dev;
+
+static const struct attribute_group *pio_groups[] =
+{
+  &drv_core_stats_group,
+  NULL
+};
+
+/* pins driven by /dev/pio, bit n of every mask is pins[n] */
+#define PIO_MAX_PINS 32
+
+static int pins[PIO_MAX_PINS] = { 4 };
+static int nr_pins = 1;
+module_param_array(pins, int, &nr_pins, 0444);
+MODULE_PARM_DESC(pins, "GPIO numbers driven by /dev/pio, bit n of a mask is pins[n] (default 4, the LED)");
+
+static struct gpio_desc *pio_descs[PIO_MAX_PINS];
+
+/* command stream, at most one page is executed per write() */
+#define PIO_CMD_CHUNK       PAGE_SIZE
+#define PIO_CMD_MAX_US      1000000UL
+#define PIO_CMD_MAX_MS      10000UL
+#define PIO_CMD_UDELAY_MAX  10UL      /*busy wait below, sleep above*/
+
+/*
+ * shadow of the pin levels ('T' toggles them). pio_lock keeps the commands
+ * of a batch between two delays and the ioctls from interleaving (it is
+ * dropped while a 'u' / 'm' delay sleeps), pio_level_lock serialises them
+ * with the waveform timer.
+ */
+static unsigned long pio_levels;
+static DEFINE_MUTEX(pio_lock);
+static DEFINE_SPINLOCK(pio_level_lock);
+
+/*a pin behind a sleeping controller (i2c / spi expander), no waveform then*/
+static bool pio_cansleep;
+
+/*
+ * waveform played by the hrtimer: edges[idx] is driven on mask, the next
+ * edge follows hold_ns later. The expiry times are absolute, a late edge
+ * does not shift the ones after it. Protected by pio_level_lock, start /
+ * stop are serialised by pio_lock.
+ */
+struct pio_wave
+{
+  struct hrtimer timer;
+  struct pio_edge *edges;
+  u32 nr_edges;
+  u32 repeat;
+  u32 idx;
+  u32 round;
+  unsigned long mask;             /*pins owned by the timer, 0 when idle*/
+  struct pio_wave_stats stats;
+};
+
+static struct pio_wave pio_wave;
+
+/*
+ * input pins: every edge interrupt is timestamped and queued to the files
+ * watching the pin. pio_input_mask changes under pio_lock, pio_watch_lock
+ * protects the watcher list against the interrupt.
+ */
+#define PIO_EDGE_FIFO 256   /*events per file, power of two*/
+
+static unsigned long pio_input_mask;
+static int pio_irqs[PIO_MAX_PINS];
+static LIST_HEAD(pio_watchers);
+static DEFINE_SPINLOCK(pio_watch_lock);
+
+/*
+ * per open file state, '0' / '1' / 'T' act on the pins selected with
+ * 'p<hex mask>', read() returns levels or, with a watch mask, edge events
+ */
+struct pio_file
+{
+  unsigned long select;
+  unsigned long watch;          /*input pins recorded in events, 0: level reads*/
+  struct list_head node;        /*on pio_watchers while watch != 0*/
+  DECLARE_KFIFO(events, struct pio_edge_event, PIO_EDGE_FIFO);
+  wait_queue_head_t wait;
+  struct mutex read_lock;       /*one consumer of events at a time*/
+  u32 dropped;                  /*events lost to a full FIFO*/
+};
+
+/*
+ * @brief mask of all configured pins
+ */
+static unsigned long pio_all_pins(void)
+{
+  return GENMASK(nr_pins - 1, 0);
+}
+
+/*
+ * @brief drive the masked pins to value, the others keep their level.
+ *        all pins go out in one gpiod_set_array_value() call, gpiolib hands
+ *        the pins of a chip to its set_multiple() (one register write on the
+ *        bcm2835). caller holds pio_level_lock
+ */
+static void pio_drive(unsigned long mask, unsigned long value)
+{
+  pio_levels = (pio_levels & ~mask) | (value & mask);
+  gpiod_set_array_value(nr_pins, pio_descs, NULL, &pio_levels);
+}
+
+/*
+ * @brief pio_drive() for process context, pins owned by a running waveform
+ *        are left alone. caller holds pio_lock
+ */
+static void pio_apply(unsigned long mask, unsigned long value)
+{
+  unsigned long flags;
+
+  mask &= pio_all_pins();
+
+  if(pio_cansleep)
+  {
+    /*no waveform on sleeping pins, pio_lock is enough*/
+    pio_levels = (pio_levels & ~mask) | (value & mask);
+    gpiod_set_array_value_cansleep(nr_pins, pio_descs, NULL, &pio_levels);
+    return;
+  }
+
+  spin_lock_irqsave(&pio_level_lock, flags);
+  pio_drive(mask & ~(pio_wave.mask | pio_input_mask), value);
+  spin_unlock_irqrestore(&pio_level_lock, flags);
+}
+
+/*
+ * @brief hrtimer callback, drives one edge of the waveform and arms the next
+ */
+static enum hrtimer_restart pio_wave_edge(struct hrtimer *timer)
+{
+  struct pio_wave *w = container_of(timer, struct pio_wave, timer);
+  ktime_t expires = hrtimer_get_expires(timer);
+  ktime_t now = ktime_get();
+  s64 late = ktime_to_ns(ktime_sub(now, expires));
+  enum hrtimer_restart ret = HRTIMER_RESTART;
+
+  spin_lock(&pio_level_lock);
+
+  pio_drive(w->mask, w->edges[w->idx].value);
+
+  w->stats.edges++;
+  w->stats.late_sum_ns += max_t(s64, late, 0);
+  w->stats.late_max_ns = max_t(u64, w->stats.late_max_ns, max_t(s64, late, 0));
+
+  expires = ktime_add_ns(expires, w->edges[w->idx].hold_ns);
+  if(ktime_before(expires, now))
+    w->stats.overruns++;
+
+  if(++w->idx == w->nr_edges)
+  {
+    w->idx = 0;
+    if(w->repeat && ++w->round == w->repeat)
+    {
+      /*done, the pins go back to the command stream and the ioctls*/
+      w->mask = 0;
+      ret = HRTIMER_NORESTART;
+    }
+  }
+
+  spin_unlock(&pio_level_lock);
+
+  if(ret == HRTIMER_RESTART)
+    hrtimer_set_expires(timer, expires);
+  return ret;
+}
+
+/*
+ * @brief stop the waveform, the pins keep their last level. caller holds pio_lock
+ */
+static void pio_wave_stop(void)
+{
+  unsigned long flags;
+
+  hrtimer_cancel(&pio_wave.timer);
+
+  spin_lock_irqsave(&pio_level_lock, flags);
+  pio_wave.mask = 0;
+  spin_unlock_irqrestore(&pio_level_lock, flags);
+
+  kfree(pio_wave.edges);
+  pio_wave.edges = NULL;
+}
+
+/*
+ * @brief replace the running waveform by the one described in wave.
+ *        caller holds pio_lock
+ * @return 0 when OK, negative errno otherwise
+ */
+static int pio_wave_start(const struct pio_wave_desc *wave)
+{
+  struct pio_edge *edges;
+  unsigned long flags;
+  u32 i;
+
+  if(pio_cansleep)
+    return -EOPNOTSUPP;
+  if(wave->mask == 0 || (wave->mask & ~pio_all_pins()) ||
+     wave->nr_edges == 0 || wave->nr_edges > PIO_WAVE_MAX_EDGES)
+    return -EINVAL;
+  if(wave->mask & pio_input_mask)
+    return -EBUSY;
+
+  edges = memdup_user(u64_to_user_ptr(wave->edges), wave->nr_edges * sizeof(*edges));
+  if(IS_ERR(edges))
+    return PTR_ERR(edges);
+
+  /*a too short hold would keep the cpu in the timer interrupt*/
+  for(i = 0; i < wave->nr_edges; i++)
+  {
+    if(edges[i].hold_ns < PIO_WAVE_MIN_HOLD_NS)
+    {
+      kfree(edges);
+      return -EINVAL;
+    }
+  }
+
+  pio_wave_stop();
+
+  spin_lock_irqsave(&pio_level_lock, flags);
+  pio_wave.edges = edges;
+  pio_wave.nr_edges = wave->nr_edges;
+  pio_wave.repeat = wave->repeat;
+  pio_wave.idx = 0;
+  pio_wave.round = 0;
+  pio_wave.mask = wave->mask;
+  memset(&pio_wave.stats, 0, sizeof(pio_wave.stats));
+  spin_unlock_irqrestore(&pio_level_lock, flags);
+
+  /*hard: the edges are driven from the timer interrupt on PREEMPT_RT too*/
+  hrtimer_start(&pio_wave.timer, ktime_get(), HRTIMER_MODE_ABS_HARD);
+  return 0;
+}
+
+/*
+ * @brief edge interrupt of an input pin, queues a timestamped event to
+ *        every file watching the pin
+ */
+static irqreturn_t pio_edge_irq(int irq, void *data)
+{
+  unsigned int pin = (unsigned long)data;
+  struct pio_edge_event ev =
+  {
+    .timestamp_ns = ktime_get_ns(),
+    .pin          = pin,
+    .level        = gpiod_get_value(pio_descs[pin])
+  };
+  struct pio_file *pf;
+
+  spin_lock(&pio_watch_lock);
+  list_for_each_entry(pf, &pio_watchers, node)
+  {
+    if(!(pf->watch & BIT(pin)))
+      continue;
+
+    if(kfifo_put(&pf->events, ev))
+      wake_up_interruptible_poll(&pf->wait, EPOLLIN | EPOLLRDNORM);
+    else
+      pf->dropped++;
+  }
+  spin_unlock(&pio_watch_lock);
+
+  return IRQ_HANDLED;
+}
+
+/*
+ * @brief make the pins of mask inputs with edge interrupts, the other
+ *        input pins become outputs again at their shadow level.
+ *        pins changed before an error keep their new direction.
+ *        caller holds pio_lock
+ * @return 0 when OK, negative errno otherwise
+ */
+static int pio_set_input(unsigned long mask)
+{
+  void *cookie;
+  int i, irq, ret;
+
+  if(mask & ~pio_all_pins())
+    return -EINVAL;
+  if(mask && pio_cansleep)
+    return -EOPNOTSUPP;
+  if(mask & pio_wave.mask)
+    return -EBUSY;
+
+  for(i = 0; i < nr_pins; i++)
+  {
+    cookie = (void *)(unsigned long)i;
+
+    /*input -> output*/
+    if((pio_input_mask & BIT(i)) && !(mask & BIT(i)))
+    {
+      free_irq(pio_irqs[i], cookie);
+      ret = gpiod_direction_output(pio_descs[i], test_bit(i, &pio_levels));
+      if(ret)
+        return ret;
+      WRITE_ONCE(pio_input_mask, pio_input_mask & ~BIT(i));
+    }
+
+    /*output -> input, out of pio_apply()'s reach before the direction changes*/
+    if(!(pio_input_mask & BIT(i)) && (mask & BIT(i)))
+    {
+      WRITE_ONCE(pio_input_mask, pio_input_mask | BIT(i));
+
+      ret = gpiod_direction_input(pio_descs[i]);
+      irq = ret ? ret : gpiod_to_irq(pio_descs[i]);
+      ret = (irq < 0) ? irq : request_irq(irq, pio_edge_irq, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+                                          "pio", cookie);
+      if(ret)
+      {
+        pr_err("%s: %s Failed to set up GPIO %d as input (%d)\n", MODULE_NAME, __func__, pins[i], ret);
+        gpiod_direction_output(pio_descs[i], test_bit(i, &pio_levels));
+        WRITE_ONCE(pio_input_mask, pio_input_mask & ~BIT(i));
+        return ret;
+      }
+      pio_irqs[i] = irq;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * @brief record the edges of the input pins of mask in the FIFO of pf,
+ *        0 switches pf back to level reads
+ */
+static int pio_edge_watch(struct pio_file *pf, unsigned long mask)
+{
+  unsigned long flags;
+
+  if(mask & ~pio_all_pins())
+    return -EINVAL;
+
+  spin_lock_irqsave(&pio_watch_lock, flags);
+  if(mask && !pf->watch)
+  {
+    /*start with an empty FIFO, the interrupt does not see pf yet*/
+    kfifo_reset(&pf->events);
+    pf->dropped = 0;
+    list_add_tail(&pf->node, &pio_watchers);
+  }
+  else if(!mask && pf->watch)
+  {
+    list_del(&pf->node);
+  }
+  WRITE_ONCE(pf->watch, mask);
+  spin_unlock_irqrestore(&pio_watch_lock, flags);
+
+  return 0;
+}
+
+/*
+ * @brief current level of every pin (inputs sampled, outputs read back),
+ *        one get_multiple() per chip
+ * @return bytes copied, negative errno otherwise
+ */
+static ssize_t pio_read_levels(char __user *pbuff, size_t count)
+{
+  DECLARE_BITMAP(values, PIO_MAX_PINS) = { 0 };
+  __u32 levels;
+  int ret;
+
+  if(count < sizeof(levels))
+    return -EINVAL;
+
+  if(pio_cansleep)
+    ret = gpiod_get_array_value_cansleep(nr_pins, pio_descs, NULL, values);
+  else
+    ret = gpiod_get_array_value(nr_pins, pio_descs, NULL, values);
+  if(ret)
+    return ret;
+
+  levels = values[0];
+  if(copy_to_user(pbuff, &levels, sizeof(levels)))
+    return -EFAULT;
+
+  return sizeof(levels);
+}
+
+/*
+ * @brief drain as many whole edge events as fit into the user buffer,
+ *        wait for the first one unless O_NONBLOCK
+ * @return bytes copied, negative errno otherwise
+ */
+static ssize_t pio_read_events(struct file *pfile, char __user *pbuff, size_t count)
+{
+  struct pio_file *pf = pfile->private_data;
+  unsigned int copied = 0;
+  int ret;
+
+  if(count < sizeof(struct pio_edge_event))
+    return -EINVAL;
+
+  if(mutex_lock_interruptible(&pf->read_lock))
+    return -ERESTARTSYS;
+
+  while(kfifo_is_empty(&pf->events))
+  {
+    mutex_unlock(&pf->read_lock);
+
+    if(pfile->f_flags & O_NONBLOCK)
+      return -EAGAIN;
+
+    if(wait_event_interruptible(pf->wait, !kfifo_is_empty(&pf->events)))
+      return -ERESTARTSYS;
+
+    if(mutex_lock_interruptible(&pf->read_lock))
+      return -ERESTARTSYS;
+  }
+
+  ret = kfifo_to_user(&pf->events, pbuff, count, &copied);
+  mutex_unlock(&pf->read_lock);
+
+  return ret ? ret : copied;
+}
+
+/*
+ * @brief wait between two commands of the stream, without pio_lock. 'm'
+ *        sleeps interruptibly, 'u' (at most 1 s) is checked afterwards
+ * @return 0 when OK, -ERESTARTSYS when a signal is pending
+ */
+static int pio_delay(char unit, unsigned long value)
+{
+  if(unit == 'm')
+    msleep_interruptible(value);
+  else if(value <= PIO_CMD_UDELAY_MAX)
+    udelay(value);
+  else
+    usleep_range(value, value + value / 16);
+
+  return signal_pending(current) ? -ERESTARTSYS : 0;
+}
+
+/*
+ * @brief execute the command stream written by user space on the pins
+ * @return bytes consumed, negative errno when nothing could be executed
+ */
+static ssize_t pio_write(struct pio_file *pf, const char __user *pbuff, size_t count)
+{
+  size_t len = min_t(size_t, count, PIO_CMD_CHUNK), pos = 0;
+  ssize_t ret = 0;
+  char *cmds;
+
+  /*copy user data*/
+  cmds = memdup_user(pbuff, len);
+  if(IS_ERR(cmds))
+    return PTR_ERR(cmds);
+
+  if(mutex_lock_interruptible(&pio_lock))
+  {
+    kfree(cmds);
+    return -ERESTARTSYS;
+  }
+
+  while(pos < len && ret == 0)
+  {
+    char c = cmds[pos];
+
+    switch(c)
+    {
+      case '0':
+        pio_apply(pf->select, 0);
+        pos++;
+        break;
+      case '1':
+        pio_apply(pf->select, ~0UL);
+        pos++;
+        break;
+      case 'T':
+      case 't':
+        pio_apply(pf->select, ~pio_levels);
+        pos++;
+        break;
+      case 'u':
+      case 'm':
+      case 'p':
+      {
+        unsigned int base = (c == 'p') ? 16 : 10;
+        unsigned long value = 0, max;
+        size_t token = pos++;
+        bool overflow = false;
+        int digit;
+
+        max = (c == 'm') ? PIO_CMD_MAX_MS : (c == 'u') ? PIO_CMD_MAX_US : pio_all_pins();
+
+        while(pos < len && (digit = hex_to_bin(cmds[pos])) >= 0 && digit < base)
+        {
+          /*value * base + digit > max, checked before it can wrap (max is ~0UL with 32 pins on arm)*/
+          if(digit > max || value > (max - digit) / base)
+          {
+            overflow = true;
+            break;
+          }
+          value = value * base + digit;
+          pos++;
+        }
+
+        /*the number may continue in the next page, leave it to the next write()*/
+        if(!overflow && pos == len && len < count && token != 0)
+        {
+          pos = token;
+          goto out;
+        }
+
+        if(pos == token + 1 || overflow)
+        {
+          pr_err("%s: %s invalid number at offset %zu.\n", MODULE_NAME, __func__, token);
+          pos = token;
+          ret = -EINVAL;
+          break;
+        }
+
+        if(c == 'p')
+        {
+          pf->select = value;
+          break;
+        }
+
+        /*other writers and the ioctls run while this stream waits, a signal aborts it*/
+        mutex_unlock(&pio_lock);
+        ret = pio_delay(c, value);
+        mutex_lock(&pio_lock);
+        break;
+      }
+      case ' ':
+      case ',':
+      case '\t':
+      case '\r':
+      case '\n':
+        pos++;
+        break;
+      default:
+        pr_err("%s: %s invalid value at offset %zu.\n", MODULE_NAME, __func__, pos);
+        ret = -EINVAL;
+        break;
+    }
+  }
+
+out:
+  mutex_unlock(&pio_lock);
+  kfree(cmds);
 
-/*cdev variable*/
-struct cdev pcdev;
+  /*report what was executed, the error only when nothing was*/
+  return pos ? pos : ret;
+}
 
 ssize_t _write(struct file *pfile, const char __user *pbuff, size_t count, loff_t *poff)
 {
-  char value;
-  int to_copy, not_copied, delta;
+  u64 start, latency;
+  ssize_t ret;
 
-  pr_info("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
 
   if(pbuff == NULL || poff == NULL)
   {
@@ -57,144 +646,287 @@ ssize_t _write(struct file *pfile, const char __user *pbuff, size_t count, loff_
     return -EINVAL;
   }
 
-  /*get size of data to copy*/
-  to_copy = min(count, sizeof(value));
+  start = ktime_get_ns();
+  ret = pio_write(pfile->private_data, pbuff, count);
+  latency = ktime_get_ns() - start;
 
-  /*copy user data*/
-  not_copied = copy_from_user(&value, pbuff, to_copy);
+  drv_core_account(pio_dev, DRV_STAT_WRITE, ret, latency);
+  trace_pio_write(count, ret, latency);
+  return ret;
+}
 
-  /*setting the LED*/
-  switch(value)
+ssize_t _read(struct file *pfile, char __user *pbuff, size_t count, loff_t *poff)
+{
+  struct pio_file *pf = pfile->private_data;
+  u64 start, latency;
+  ssize_t ret;
+
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+
+  if(pbuff == NULL || poff == NULL)
   {
-    case '0':
-      gpio_set_value(4, 0);
-      break;
-    case '1':
-      gpio_set_value(4, 1);
-      break;
-    default:
-      pr_err("%s: %s invalid value.\n", MODULE_NAME, __func__);
-      break;
-  } 
+    pr_err("%s: %s invalid parameters.\n", MODULE_NAME, __func__);
+    return -EINVAL;
+  }
+
+  start = ktime_get_ns();
+  if(READ_ONCE(pf->watch))
+    ret = pio_read_events(pfile, pbuff, count);
+  else
+    ret = pio_read_levels(pbuff, count);
+  latency = ktime_get_ns() - start;
+
+  drv_core_account(pio_dev, DRV_STAT_READ, ret, latency);
+  trace_pio_read(count, ret, latency);
+  return ret;
+}
+
+__poll_t _poll(struct file *pfile, poll_table *wait)
+{
+  struct pio_file *pf = pfile->private_data;
+  __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+  /*levels can always be read*/
+  if(!READ_ONCE(pf->watch))
+    return mask | EPOLLIN | EPOLLRDNORM;
+
+  poll_wait(pfile, &pf->wait, wait);
+  if(!kfifo_is_empty(&pf->events))
+    mask |= EPOLLIN | EPOLLRDNORM;
+
+  return mask;
+}
+
+long _ioctl(struct file *pfile, unsigned int cmd, unsigned long arg)
+{
+  struct pio_file *pf = pfile->private_data;
+  struct pio_wave_stats stats;
+  struct pio_wave_desc wave;
+  struct pio_mask m;
+  unsigned long flags;
+  __u32 levels, pinmask;
+  int ret;
+
+  switch(cmd)
+  {
+    case PIO_IOC_SET_MASK:
+      if(copy_from_user(&m, (void __user *)arg, sizeof(m)))
+        return -EFAULT;
+      if(m.mask & ~pio_all_pins())
+        return -EINVAL;
+
+      /*the pins of a running waveform belong to the timer, inputs are not driven*/
+      if(m.mask & (READ_ONCE(pio_wave.mask) | READ_ONCE(pio_input_mask)))
+        return -EBUSY;
+
+      mutex_lock(&pio_lock);
+      pio_apply(m.mask, m.value);
+      mutex_unlock(&pio_lock);
+      return 0;
+
+    case PIO_IOC_GET_LEVELS:
+      spin_lock_irqsave(&pio_level_lock, flags);
+      levels = pio_levels;
+      spin_unlock_irqrestore(&pio_level_lock, flags);
+      return put_user(levels, (__u32 __user *)arg);
+
+    case PIO_IOC_WAVE_START:
+      if(copy_from_user(&wave, (void __user *)arg, sizeof(wave)))
+        return -EFAULT;
+
+      mutex_lock(&pio_lock);
+      ret = pio_wave_start(&wave);
+      mutex_unlock(&pio_lock);
+      return ret;
+
+    case PIO_IOC_WAVE_STOP:
+      mutex_lock(&pio_lock);
+      pio_wave_stop();
+      mutex_unlock(&pio_lock);
+      return 0;
+
+    case PIO_IOC_WAVE_STATS:
+      spin_lock_irqsave(&pio_level_lock, flags);
+      stats = pio_wave.stats;
+      stats.running = pio_wave.mask != 0;
+      spin_unlock_irqrestore(&pio_level_lock, flags);
+      return copy_to_user((void __user *)arg, &stats, sizeof(stats)) ? -EFAULT : 0;
 
-  /*calculate delta*/
-  delta = to_copy - not_copied;
+    case PIO_IOC_SET_INPUT:
+      if(get_user(pinmask, (__u32 __user *)arg))
+        return -EFAULT;
 
-  return delta;
+      mutex_lock(&pio_lock);
+      ret = pio_set_input(pinmask);
+      mutex_unlock(&pio_lock);
+      return ret;
+
+    case PIO_IOC_EDGE_WATCH:
+      if(get_user(pinmask, (__u32 __user *)arg))
+        return -EFAULT;
+      return pio_edge_watch(pf, pinmask);
+
+    case PIO_IOC_EDGE_DROPPED:
+      spin_lock_irqsave(&pio_watch_lock, flags);
+      levels = pf->dropped;
+      pf->dropped = 0;
+      spin_unlock_irqrestore(&pio_watch_lock, flags);
+      return put_user(levels, (__u32 __user *)arg);
+
+    default:
+      return -ENOTTY;
+  }
 }
 
 int _open(struct inode *node, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  struct pio_file *pf;
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+
+  pf = kzalloc(sizeof(*pf), GFP_KERNEL);
+  if(pf == NULL)
+    return -ENOMEM;
+
+  pf->select = pio_all_pins();
+  INIT_LIST_HEAD(&pf->node);
+  INIT_KFIFO(pf->events);
+  init_waitqueue_head(&pf->wait);
+  mutex_init(&pf->read_lock);
+  pfile->private_data = pf;
+
+  drv_core_account(pio_dev, DRV_STAT_OPEN, 0, 0);
+  trace_pio_open(pfile->f_flags);
   return 0;
 }
 
 int _release(struct inode *pnode, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+  pio_edge_watch(pfile->private_data, 0);
+  kfree(pfile->private_data);
+  drv_core_account(pio_dev, DRV_STAT_RELEASE, 0, 0);
+  trace_pio_release(pfile->f_flags);
   return 0;
 }
 
 /*file operations of the driver*/
 struct file_operations pcfops =
 {
-  .open    = _open,
-  .write   = _write,
-  .read    = NULL,
-  .release = _release,
-  .owner   = THIS_MODULE
+  .open           = _open,
+  .write          = _write,
+  .read           = _read,
+  .poll           = _poll,
+  .unlocked_ioctl = _ioctl,
+  .release        = _release,
+  .owner          = THIS_MODULE
 };
 
-struct class *pdclass;
-struct device *pdevice;
-
-/*-------------------------------------------------------------------*/
-/*define static functions*/
 /*
- * @brief this function is called, when the module is loaded into the kernel
+ * @brief request every configured pin as output, low
+ * @return 0 when OK, negative errno otherwise (no pin is held then)
  */
-static int __init ModuleCharacterDeviceInit(void)
+static int pio_pins_init(void)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  int i, ret;
+
+  if(nr_pins < 1 || nr_pins > PIO_MAX_PINS)
+    return -EINVAL;
 
-  /*1. dynamically allocate a device number (creates device number)*/
-  if(alloc_chrdev_region(&device_number, 0 /*first minor*/, 1 /*counts*/, "iodevice") < 0)
+  for(i = 0; i < nr_pins; i++)
   {
-    pr_err("%s: %s Failed to allocate a major number\n", MODULE_NAME, __func__);
-    return -1;
+    ret = gpio_request_one(pins[i], GPIOF_OUT_INIT_LOW, "pio");
+    if(ret)
+    {
+      pr_err("%s: %s Failed to allocate GPIO %d\n", MODULE_NAME, __func__, pins[i]);
+      goto err_pins;
+    }
+    pio_descs[i] = gpio_to_desc(pins[i]);
+    pio_cansleep |= gpiod_cansleep(pio_descs[i]);
   }
 
-  pr_info("%s: %s device number <major>:<minor> = %d:%d\n", MODULE_NAME, __func__,
-                                                      MAJOR(device_number),
-                                                      MINOR(device_number));
+  pio_levels = 0;
+  return 0;
 
-  /*
-    - The Virtual Filesystem (also known as Virtual Filesystem Switch or VFS) is a
-      kernel software layer that handles all system calls related to a standard Unix
-      filesystem. Its main strength is providing a common interface to several kinds
-      of filesystems.
+err_pins:
+  while(i--)
+    gpio_free(pins[i]);
+  return ret;
+}
 
-    - The Virtual File System (VFS) layer [1] provides a uniform interface for the
-      kernel to deal with various I/O requests and specifies a standard interface
-      that each file system must support.
-  */
- 
-  /*2. create device class under /sys/class/ */
-  pdclass = class_create(THIS_MODULE, "iodevclass");
-  if (IS_ERR(pdclass))
-  {
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to register device class\n", MODULE_NAME, __func__);
-    return PTR_ERR(pdclass);
-  }
+/*
+ * @brief drive every pin low and release it
+ */
+static void pio_pins_exit(void)
+{
+  int i;
 
-  /*3. Create the device file in /dev and set the permissions to 0666 */
-  pdevice = device_create(pdclass, NULL, device_number, NULL, "pio");
-  if(pdevice == NULL)
-  {
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
-    return -1;
-  }
+  pio_apply(pio_all_pins(), 0);
+  for(i = 0; i < nr_pins; i++)
+    gpio_free(pins[i]);
+}
+
+/*-------------------------------------------------------------------*/
+/*define static functions*/
+/*
+ * @brief free the node with its last reference: in drv_core_dev_del or,
+ *        with a file still open, at its last close
+ */
+static void pio_release(struct drv_core_dev *cd)
+{
+  kfree(cd);
+}
+
+/*
+ * @brief this function is called, when the module is loaded into the kernel
+ */
+static int __init ModuleCharacterDeviceInit(void)
+{
+  int ret;
+
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+
+  /*1. device number and /sys/class/iodevclass/ from the driver core*/
+  ret = drv_core_register(&pio_core, THIS_MODULE, "iodevclass", 1);
+  if(ret)
+    return ret;
 
-  /*4. Initialize the character device and add it to the system*/
-  cdev_init(&pcdev, &pcfops);
-  pcdev.owner = THIS_MODULE;
+  /*2. Init the GPIOs before user space can reach them*/
+  hrtimer_init(&pio_wave.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+  pio_wave.timer.function = pio_wave_edge;
 
-  /*5. register a device (cdev structure) with VFS*/  
-  if(cdev_add(&pcdev, device_number, 1) < 0)
+  ret = pio_pins_init();
+  if(ret)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to add the cdev\n", MODULE_NAME, __func__);
-    return -1;
+    pr_err("%s: %s Failed to set up %d GPIOs as out\n", MODULE_NAME, __func__, nr_pins);
+    goto err_core;
   }
 
-  /*6. Init GPIO4 - Connected with LED*/
-  if(gpio_request(4, "rpi-gpio-4"))
+  /*3. cdev and /dev/pio with its stats/ group*/
+  pio_dev = kzalloc(sizeof(*pio_dev), GFP_KERNEL);
+  if(pio_dev == NULL)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to allocate GPIO 4\n", MODULE_NAME, __func__);
-    return -1;
+    ret = -ENOMEM;
+    goto err_pins;
   }
 
-  /*7. Set the direction of the PIN*/
-  if(gpio_direction_output(4, 0))
+  pio_dev->release = pio_release;
+  ret = drv_core_dev_add(&pio_core, pio_dev, &pcfops, NULL, NULL, pio_groups, "pio");
+  if(ret)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    gpio_free(4);
-    pr_err("%s: %s Can not set GPIO 4 to out\n", MODULE_NAME, __func__);
-    return -1;
+    /*the node took pio_dev along*/
+    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
+    goto err_pins;
   }
 
-  pr_info("%s: %s device created successfully..\n", MODULE_NAME, __func__);
+  pr_info("%s: %s device created successfully, %d pins..\n", MODULE_NAME, __func__, nr_pins);
   return 0;
+
+err_pins:
+  pio_pins_exit();
+err_core:
+  drv_core_unregister(&pio_core);
+  return ret;
 }
 
 /*
@@ -205,12 +937,11 @@ static void __exit ModuleCharacterDeviceExit(void)
   pr_info("%s: executing %s\n", MODULE_NAME, __func__);
   
   /*cleanup task*/
-  device_destroy(pdclass, device_number);
-  class_destroy(pdclass);
-  cdev_del(&pcdev);
-  unregister_chrdev_region(device_number, 1);
-  gpio_set_value(4, 0);
-  gpio_free(4);
+  drv_core_dev_del(pio_dev);
+  drv_core_unregister(&pio_core);
+  pio_wave_stop();
+  pio_set_input(0);
+  pio_pins_exit();
   pr_info("%s: %s device cleaned up successfully..\n", MODULE_NAME, __func__);
 }
 
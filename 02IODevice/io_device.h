@@ -0,0 +1,93 @@
+/************************************************************
+ *  io_device.h - Shared definitions of /dev/pio
+ *
+ *  Description:
+ *      ioctl interface of the io led driver. This header is
+ *      included by the driver and by user space.
+ *
+ *      Bit n of every mask is the n-th GPIO of the `pins` module
+ *      parameter.
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#ifndef IO_DEVICE_H
+#define IO_DEVICE_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+struct pio_mask
+{
+  __u32 mask;   /*pins to change*/
+  __u32 value;  /*new level of the changed pins*/
+};
+
+#define PIO_IOC_MAGIC 'p'
+
+/*drive (value & mask), leave the pins outside of mask untouched*/
+#define PIO_IOC_SET_MASK   _IOW(PIO_IOC_MAGIC, 1, struct pio_mask)
+/*levels of all pins as driven by the driver*/
+#define PIO_IOC_GET_LEVELS _IOR(PIO_IOC_MAGIC, 2, __u32)
+
+/*
+ * waveform: edges[i].value is driven on mask, then held for hold_ns before
+ * edges[i + 1]. The list is played repeat times (0: until stopped).
+ * PWM of period P and duty D is { {mask, D}, {0, P - D} }.
+ */
+#define PIO_WAVE_MAX_EDGES    1024
+#define PIO_WAVE_MIN_HOLD_NS  5000
+
+struct pio_edge
+{
+  __u32 value;
+  __u32 reserved;
+  __u64 hold_ns;
+};
+
+struct pio_wave_desc
+{
+  __u32 mask;       /*pins played by the waveform*/
+  __u32 nr_edges;
+  __u32 repeat;
+  __u32 reserved;
+  __u64 edges;      /*user pointer to nr_edges struct pio_edge*/
+};
+
+/*timing of the running (or last) waveform*/
+struct pio_wave_stats
+{
+  __u64 edges;        /*edges driven*/
+  __u64 late_sum_ns;  /*sum of edge delays behind the schedule*/
+  __u64 late_max_ns;  /*worst edge delay*/
+  __u64 overruns;     /*edges whose successor was already due*/
+  __u32 running;
+  __u32 reserved;
+};
+
+#define PIO_IOC_WAVE_START _IOW(PIO_IOC_MAGIC, 3, struct pio_wave_desc)
+#define PIO_IOC_WAVE_STOP  _IO(PIO_IOC_MAGIC, 4)
+#define PIO_IOC_WAVE_STATS _IOR(PIO_IOC_MAGIC, 5, struct pio_wave_stats)
+
+/*
+ * inputs: pins of the PIO_IOC_SET_INPUT mask become inputs with an edge
+ * interrupt (the others outputs). After PIO_IOC_EDGE_WATCH with a non-zero
+ * mask, read() on that file returns the edges of those pins as records.
+ */
+struct pio_edge_event
+{
+  __u64 timestamp_ns;   /*CLOCK_MONOTONIC, taken in the interrupt*/
+  __u32 pin;            /*bit number in the masks*/
+  __u32 level;          /*level after the edge*/
+};
+
+#define PIO_IOC_SET_INPUT    _IOW(PIO_IOC_MAGIC, 6, __u32)
+#define PIO_IOC_EDGE_WATCH   _IOW(PIO_IOC_MAGIC, 7, __u32)
+/*events this file lost to a full FIFO since the last call*/
+#define PIO_IOC_EDGE_DROPPED _IOR(PIO_IOC_MAGIC, 8, __u32)
+
+#endif /* IO_DEVICE_H */
@@ -0,0 +1,94 @@
+/************************************************************
+ *  io_device_trace.h - Tracepoints of /dev/pio
+ *
+ *  Description:
+ *      open / read / write / release tracepoints of the io led driver.
+ *      They cost a static branch when disabled.
+ *
+ *  Usage:
+ *      - trace-cmd record -e io_device
+ *      - perf record -e 'io_device:*'
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM io_device
+
+#if !defined(_IO_DEVICE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _IO_DEVICE_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(pio_file,
+
+  TP_PROTO(unsigned int flags),
+
+  TP_ARGS(flags),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, flags)
+  ),
+
+  TP_fast_assign(
+    __entry->flags = flags;
+  ),
+
+  TP_printk("flags=0x%x", __entry->flags)
+);
+
+DEFINE_EVENT(pio_file, pio_open,
+  TP_PROTO(unsigned int flags),
+  TP_ARGS(flags)
+);
+
+DEFINE_EVENT(pio_file, pio_release,
+  TP_PROTO(unsigned int flags),
+  TP_ARGS(flags)
+);
+
+/* read and write share the layout */
+DECLARE_EVENT_CLASS(pio_io,
+
+  TP_PROTO(size_t requested, ssize_t ret, u64 latency_ns),
+
+  TP_ARGS(requested, ret, latency_ns),
+
+  TP_STRUCT__entry(
+    __field(size_t, requested)
+    __field(ssize_t, ret)
+    __field(u64, latency_ns)
+  ),
+
+  TP_fast_assign(
+    __entry->requested = requested;
+    __entry->ret = ret;
+    __entry->latency_ns = latency_ns;
+  ),
+
+  TP_printk("requested=%zu ret=%zd latency_ns=%llu",
+            __entry->requested, __entry->ret, __entry->latency_ns)
+);
+
+DEFINE_EVENT(pio_io, pio_read,
+  TP_PROTO(size_t requested, ssize_t ret, u64 latency_ns),
+  TP_ARGS(requested, ret, latency_ns)
+);
+
+DEFINE_EVENT(pio_io, pio_write,
+  TP_PROTO(size_t requested, ssize_t ret, u64 latency_ns),
+  TP_ARGS(requested, ret, latency_ns)
+);
+
+#endif /* _IO_DEVICE_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE io_device_trace
+#include <trace/define_trace.h>
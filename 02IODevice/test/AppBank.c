@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "../io_device.h"
+
+#define DEVICE_PATH "/dev/pio"
+#define PINS_PATH "/sys/module/io_device/parameters/pins"
+#define BANK_UPDATES 100000   // Mask updates per benchmark run
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Number of pins io_device.ko drives: the entries of its pins= parameter, 1 when it is unreadable
+static int loaded_pins(void) {
+    FILE *f = fopen(PINS_PATH, "r");
+    int c, nr_pins = 1;
+
+    if (f == NULL)
+        return 1;
+    while ((c = fgetc(f)) != EOF)
+        if (c == ',')
+            nr_pins++;
+    fclose(f);
+    return nr_pins;
+}
+
+int main(int argc, char *argv[]) {
+    // Number of pins passed to io_device.ko (pins=...), read from sysfs by default
+    int nr_pins = argc > 1 ? atoi(argv[1]) : loaded_pins();
+    uint32_t all = nr_pins >= 32 ? 0xffffffffu : (1u << nr_pins) - 1;
+    struct pio_mask m = { all, 0 };
+    uint32_t levels;
+    double start, seconds;
+    int fd;
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open " DEVICE_PATH);
+        return EXIT_FAILURE;
+    }
+
+    // Walk a counter over all pins, every update is one ioctl() and one bank write
+    start = now_sec();
+    for (uint32_t i = 0; i < BANK_UPDATES; i++) {
+        m.value = i;
+        if (ioctl(fd, PIO_IOC_SET_MASK, &m) == -1) {
+            perror("PIO_IOC_SET_MASK");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+    }
+    seconds = now_sec() - start;
+
+    if (ioctl(fd, PIO_IOC_GET_LEVELS, &levels) == -1) {
+        perror("PIO_IOC_GET_LEVELS");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    if (levels != (m.value & all)) {
+        fprintf(stderr, "levels 0x%08x, expected 0x%08x\n", levels, m.value & all);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    // Leave every pin low
+    m.value = 0;
+    ioctl(fd, PIO_IOC_SET_MASK, &m);
+    close(fd);
+
+    printf("%d pins: %d mask updates in %.3f s, %.1f ns/update\n", nr_pins, BANK_UPDATES,
+           seconds, seconds * 1e9 / BANK_UPDATES);
+    return EXIT_SUCCESS;
+}
@@ -1,14 +1,31 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "../io_device.h"
 
 #define DEVICE_PATH "/dev/pio"
-#define SLEEP_DURATION 1 // Sleep duration in seconds
+#define SLEEP_DURATION_MS 1000 // On and off time in milliseconds
+#define BLINK_COUNT 10
+#define LED_MASK 0x1           // pins[0], GPIO 4 by default
 
 int main() {
     int fd;
-    char write_buffer[2];
+
+    // One on edge and one off edge, played BLINK_COUNT times by the driver
+    struct pio_edge edges[] = {
+        { .value = LED_MASK, .hold_ns = SLEEP_DURATION_MS * 1000000ULL },
+        { .value = 0,        .hold_ns = SLEEP_DURATION_MS * 1000000ULL },
+    };
+    struct pio_wave_desc wave = {
+        .mask = LED_MASK,
+        .nr_edges = sizeof(edges) / sizeof(edges[0]),
+        .repeat = BLINK_COUNT,
+        .edges = (uintptr_t)edges,
+    };
 
     // Open the /dev/pio device file
     fd = open(DEVICE_PATH, O_WRONLY);
@@ -17,30 +34,15 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    // Loop 10 times to write 1, sleep, then write 0, sleep
-    for (int i = 0; i < 10; i++) {
-        // Write '1' to the device
-        write_buffer[0] = '1';
-        if (write(fd, write_buffer, 1) == -1) {
-            perror("Failed to write '1' to /dev/pio");
-            close(fd);
-            return EXIT_FAILURE;
-        }
-        sleep(SLEEP_DURATION); // Sleep for 1 second
-
-        // Write '0' to the device
-        write_buffer[0] = '0';
-        if (write(fd, write_buffer, 1) == -1) {
-            perror("Failed to write '0' to /dev/pio");
-            close(fd);
-            return EXIT_FAILURE;
-        }
-        sleep(SLEEP_DURATION); // Sleep for 1 second
+    // The driver times the edges with an hrtimer, nothing is left to do here
+    if (ioctl(fd, PIO_IOC_WAVE_START, &wave) == -1) {
+        perror("Failed to start the blink pattern on /dev/pio");
+        close(fd);
+        return EXIT_FAILURE;
     }
 
-    // Close the device file
+    // Close the device file, the pattern keeps running
     close(fd);
-    printf("Toggled /dev/pio 10 times.\n");
+    printf("Started blinking /dev/pio %d times.\n", BLINK_COUNT);
     return EXIT_SUCCESS;
 }
-
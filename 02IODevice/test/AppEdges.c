@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "../io_device.h"
+
+#define DEVICE_PATH "/dev/pio"
+#define BATCH 64          // Edge records per read()
+
+int main(int argc, char *argv[]) {
+    // Pins (bit n = pins[n] of io_device.ko) to watch, pins[0] by default (there always is one)
+    uint32_t mask = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x1;
+    struct pio_edge_event ev[BATCH];
+    struct pollfd pfd;
+    uint32_t levels, dropped;
+    int fd;
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open " DEVICE_PATH);
+        return EXIT_FAILURE;
+    }
+
+    // Without a watch mask read() returns the level of every pin
+    if (read(fd, &levels, sizeof(levels)) != sizeof(levels)) {
+        perror("Failed to read the levels");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    printf("levels 0x%08x\n", levels);
+
+    if (ioctl(fd, PIO_IOC_SET_INPUT, &mask) == -1 || ioctl(fd, PIO_IOC_EDGE_WATCH, &mask) == -1) {
+        perror("Failed to watch the edges");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    // Every wake-up drains all queued edges with one read()
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    printf("waiting for edges on mask 0x%08x (Ctrl-C to stop)\n", mask);
+    while (poll(&pfd, 1, -1) > 0) {
+        ssize_t n = read(fd, ev, sizeof(ev));
+        if (n == -1) {
+            perror("Failed to read the edges");
+            break;
+        }
+        for (size_t i = 0; i < n / sizeof(ev[0]); i++)
+            printf("%llu.%09llu pin %u -> %u\n", (unsigned long long)ev[i].timestamp_ns / 1000000000ULL,
+                   (unsigned long long)ev[i].timestamp_ns % 1000000000ULL, ev[i].pin, ev[i].level);
+        if (ioctl(fd, PIO_IOC_EDGE_DROPPED, &dropped) == 0 && dropped)
+            printf("%u edges dropped\n", dropped);
+    }
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "../io_device.h"
+
+#define DEVICE_PATH "/dev/pio"
+#define PIN_MASK 0x1           // pins[0]
+#define PERIOD_NS 100000ULL    // 10 kHz PWM
+#define DUTY_NS 25000ULL       // 25 % duty cycle
+#define CYCLES 20000           // 2 s of waveform
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The same PWM toggled from user space with absolute clock_nanosleep() deadlines
+static int bench_user(int fd) {
+    struct pio_mask m = { PIN_MASK, 0 };
+    uint64_t next = now_ns(), late, late_sum = 0, late_max = 0;
+    struct timespec ts;
+
+    for (unsigned long i = 0; i < 2UL * CYCLES; i++) {
+        ts.tv_sec = next / 1000000000ULL;
+        ts.tv_nsec = next % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        late = now_ns() - next;
+        m.value = (i & 1) ? 0 : PIN_MASK;
+        if (ioctl(fd, PIO_IOC_SET_MASK, &m) == -1) {
+            perror("PIO_IOC_SET_MASK");
+            return -1;
+        }
+        late_sum += late;
+        if (late > late_max)
+            late_max = late;
+        next += (i & 1) ? PERIOD_NS - DUTY_NS : DUTY_NS;
+    }
+
+    printf("user space   %lu edges, mean late %8.1f ns, max late %8lu ns\n", 2UL * CYCLES,
+           (double)late_sum / (2 * CYCLES), (unsigned long)late_max);
+    return 0;
+}
+
+// The PWM played by the driver's hrtimer
+static int bench_kernel(int fd) {
+    struct pio_edge edges[] = {
+        { .value = PIN_MASK, .hold_ns = DUTY_NS },
+        { .value = 0,        .hold_ns = PERIOD_NS - DUTY_NS },
+    };
+    struct pio_wave_desc wave = {
+        .mask = PIN_MASK,
+        .nr_edges = 2,
+        .repeat = CYCLES,
+        .edges = (uintptr_t)edges,
+    };
+    struct pio_wave_stats stats;
+
+    if (ioctl(fd, PIO_IOC_WAVE_START, &wave) == -1) {
+        perror("PIO_IOC_WAVE_START");
+        return -1;
+    }
+    do {
+        usleep(100000);
+        if (ioctl(fd, PIO_IOC_WAVE_STATS, &stats) == -1) {
+            perror("PIO_IOC_WAVE_STATS");
+            return -1;
+        }
+    } while (stats.running);
+
+    printf("hrtimer      %llu edges, mean late %8.1f ns, max late %8llu ns, %llu overruns\n",
+           (unsigned long long)stats.edges, (double)stats.late_sum_ns / stats.edges,
+           (unsigned long long)stats.late_max_ns, (unsigned long long)stats.overruns);
+    return 0;
+}
+
+int main() {
+    int fd = open(DEVICE_PATH, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open " DEVICE_PATH);
+        return EXIT_FAILURE;
+    }
+
+    printf("PWM %llu ns period, %llu ns duty, %d cycles\n", PERIOD_NS, DUTY_NS, CYCLES);
+    if (bench_user(fd) == -1 || bench_kernel(fd) == -1) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
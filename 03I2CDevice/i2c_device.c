@@ -1,21 +1,64 @@
 /************************************************************
- *  char_driver.c - Simple Linux Kernel Pseudo Character Driver
+ *  i2c_device.c - Linux Kernel I2C Driver for BMP280 Sensors
  *
  *  Description:
- *      This is a basic Linux kernel pseudo character device driver.
- *      The driver implements open, close, read, write, and lseek operations.
+ *      This is a Linux kernel i2c client driver for Bosch BMP280
+ *      temperature and pressure sensors. Every bound sensor gets a
+ *      character device that returns compensated samples as fixed
+ *      size records, converted on demand (forced mode) or drained
+ *      from the ring of a per sensor acquisition thread, with named
+ *      measurement profiles and an optional IIO front-end.
  *      It can be used as a template for developing more complex
- *      character drivers.
+ *      i2c sensor drivers.
  *
  *  Functionality:
- *      - Registers a character device with the kernel.
- *      - Implements open, release (close), read, write, and lseek operations.
+ *      - i2c driver for BMP280 sensors: every sensor bound to the driver
+ *        (sensors= module parameter, new_device in sysfs or device tree)
+ *        gets its own state and its own character device minor,
+ *        /dev/bmp280-<bus>-<addr>.
+ *      - read() returns fixed size struct bmp280_record (i2c_device.h):
+ *        timestamp, compensated temperature and pressure, raw values and
+ *        status of one burst read of both channels.
+ *      - with odr_ms > 0 a kernel thread per sensor samples it every odr_ms
+ *        into a ring of records; every open file has its own position in
+ *        that stream, read() drains as many records as fit, blocking or
+ *        O_NONBLOCK, and poll() is supported.
+ *        with odr_ms = 0 every read() returns one record.
+ *      - forced mode (default): the sensor sleeps and converts on demand; a
+ *        delayed work item polls the status register until the conversion
+ *        is done and completes all waiting readers with the one result.
+ *        forced=0 keeps it converting continuously in normal mode.
+ *      - oversampling, IIR filter and standby of every sensor are set live
+ *        through named profiles or per field (settings/ in sysfs, ioctl),
+ *        which also report conversion time and max sample rate.
+ *      - compensation with the calibration constants derived once at
+ *        probe, where records are handed out: the sampler, the conversion
+ *        and the cache keep raw values, a read() of the stream compensates
+ *        the records it drains in one batch; the pressure terms of one
+ *        t_fine are shared by the samples that have it. 64 bit (1/256 Pa)
+ *        or pressure_64bit=0 32 bit (1 Pa) pressure formula, selftest=1
+ *        checks both against the datasheet example and logs ns / sample.
+ *      - the last sample is cached, reads within max_age_us (default: one
+ *        measurement period of the sensor) cause no bus traffic.
+ *        hits / misses under /sys/class/bmp280/<dev>/cache/.
+ *      - with CONFIG_IIO_TRIGGERED_BUFFER every sensor is an IIO device as
+ *        well: temperature and pressure channels, a triggered buffer of
+ *        both plus the kernel timestamp, driven by any IIO trigger
+ *        (e.g. iio-trig-hrtimer), read with libiio / iio_readdev.
+ *      - device numbers, /sys/class/bmp280/ and every /dev node come from
+ *        the shared driver core (drv_core.ko, 05DriverCore), as do the
+ *        per-cpu statistics (ops, bytes, errors, log2 latency histogram) of
+ *        every file operation under /sys/class/bmp280/<dev>/stats/ and the
+ *        drv_core_op tracepoint.
+ *      - open / read / release tracepoints (i2c_device_trace.h),
+ *        debug prints are pr_debug (dynamic debug).
  *
  *  Usage:
  *      - To compile: `make`
- *      - To load: `sudo insmod char_driver.ko`
- *      - To create a device node: `sudo mknod /dev/simple_char c <major> 0`
- *      - To remove: `sudo rmmod char_driver`
+ *      - To load: `sudo insmod drv_core.ko && sudo insmod i2c_device.ko sensors=1:0x76,1:0x77`
+ *      - To add a sensor later:
+ *        `echo bmp280 0x76 > /sys/bus/i2c/devices/i2c-3/new_device`
+ *      - To remove: `sudo rmmod i2c_device`
  *
  *  License:
  *      This source code is licensed under the GPL License.
@@ -31,57 +74,1225 @@
 #include <linux/device.h>
 #include <linux/slab.h>
 #include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/mod_devicetable.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <asm/unaligned.h>
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/triggered_buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#endif
+
+#include "i2c_device.h"
+#include "drv_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "i2c_device_trace.h"
 
 /* meta information */
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Kishwar Kumar");
 MODULE_DESCRIPTION("This is a basic Linux kernel drivers for i2c connecting BMP280.");
 
-static int32_t  read_temperature(void);
+struct bmp280_dev;
+struct bmp280_calib;
+
+static int read_sample(struct bmp280_dev *bmp, struct bmp280_record *rec);
+static int read_raw(struct bmp280_dev *bmp, int32_t *raw_temp, int32_t *raw_press);
+static int read_calibration(struct bmp280_dev *bmp);
+static void derive_calibration(struct bmp280_calib *c);
+static void compensate_records(const struct bmp280_calib *c, struct bmp280_record *rec, size_t n);
+
+#define MODULE_NAME "SINGLE_CHAR_I2C_DEVICE"
+
+/* device numbers (BMP280_MAX_DEVICES minors) and class from the driver core */
+static struct drv_core bmp280_core;
+
+/* Defines for device identification */
+#define I2C_BUS_AVAILABLE	1	         	/* The I2C Bus available on the raspberry */
+#define SLAVE_DEVICE_NAME	"bmp280"	  /* Device and Driver Name */
+#define BMP280_SLAVE_ADDRESS	0x76		/* BMP280 I2C address (SDO low), 0x77 with SDO high */
+#define BMP280_MAX_DEVICES	16		/* minors, one per sensor */
+
+/*
+ * sensors the module instantiates itself as "<bus>:<addr>", e.g.
+ * sensors=1:0x76,1:0x77,3:0x76. Sensors on other buses / addresses can be
+ * added at any time through new_device in sysfs or the device tree.
+ */
+static char *sensors[BMP280_MAX_DEVICES] = { __stringify(I2C_BUS_AVAILABLE) ":" __stringify(BMP280_SLAVE_ADDRESS) };
+static int nr_sensors = 1;
+module_param_array(sensors, charp, &nr_sensors, 0444);
+MODULE_PARM_DESC(sensors, "BMP280 sensors to instantiate as <bus>:<addr>, comma separated (default 1:0x76)");
+
+/* clients instantiated from sensors=, unregistered at unload */
+static struct i2c_client *bmp280_clients[BMP280_MAX_DEVICES];
+
+/* chip id register: 0x56 / 0x57 BMP280 samples, 0x58 BMP280, 0x60 BME280 (same T / P registers) */
+#define BMP280_REG_ID     0xD0
+
+/* data registers: press_msb .. temp_xlsb, read as one burst */
+#define BMP280_REG_DATA   0xF7
+#define BMP280_DATA_LEN   6
+
+/* raw value of a channel whose measurement is skipped (osrs = 0) */
+#define BMP280_RAW_SKIPPED  0x80000
+
+/* calibration: dig_T1 .. dig_T3, dig_P1 .. dig_P9, little endian, read as one burst */
+#define BMP280_REG_CALIB  0x88
+#define BMP280_CALIB_LEN  24
+
+/* measurement control: osrs_t[7:5] osrs_p[4:2] mode[1:0], config: t_sb[7:5] filter[4:2] */
+#define BMP280_REG_STATUS     0xF3
+#define BMP280_REG_CTRL_MEAS  0xF4
+#define BMP280_REG_CONFIG     0xF5
+
+#define BMP280_MEASURING      (1<<3)  /*status: conversion running*/
+#define BMP280_MODE_MASK      3       /*ctrl_meas[1:0]*/
+#define BMP280_MODE_SLEEP     0
+#define BMP280_MODE_FORCED    1
+#define BMP280_MODE_NORMAL    3
+
+/* settings of the profiles of enum bmp280_profile (i2c_device.h) */
+static const char * const bmp280_profile_names[BMP280_PROFILES] =
+{
+  [BMP280_PROFILE_DEFAULT]     = "default",
+  [BMP280_PROFILE_LOW_LATENCY] = "low_latency",
+  [BMP280_PROFILE_LOW_POWER]   = "low_power",
+  [BMP280_PROFILE_STANDARD]    = "standard",
+  [BMP280_PROFILE_LOW_NOISE]   = "low_noise",
+};
+
+static const struct bmp280_settings bmp280_profiles[BMP280_PROFILES] =
+{
+  [BMP280_PROFILE_DEFAULT]     = { .oversampling_temperature = 16, .oversampling_pressure = 16, .filter = 0,  .standby_us = 1000000 },
+  [BMP280_PROFILE_LOW_LATENCY] = { .oversampling_temperature = 1,  .oversampling_pressure = 1,  .filter = 0,  .standby_us = 500 },
+  [BMP280_PROFILE_LOW_POWER]   = { .oversampling_temperature = 1,  .oversampling_pressure = 1,  .filter = 0,  .standby_us = 4000000 },
+  [BMP280_PROFILE_STANDARD]    = { .oversampling_temperature = 1,  .oversampling_pressure = 4,  .filter = 4,  .standby_us = 62500 },
+  [BMP280_PROFILE_LOW_NOISE]   = { .oversampling_temperature = 2,  .oversampling_pressure = 16, .filter = 16, .standby_us = 500 },
+};
+
+static char *profile = "default";
+module_param(profile, charp, 0444);
+MODULE_PARM_DESC(profile, "settings of every sensor at probe: default, low_latency, low_power, standard, low_noise");
+
+static int bmp280_boot_profile;
+
+/*
+ * forced mode: one conversion per cache miss (or acquisition thread tick)
+ * instead of one every standby period. The status register is polled every
+ * BMP280_CONV_POLL_US after the datasheet's max conversion time.
+ */
+#define BMP280_CONV_POLL_US   1000
+#define BMP280_CONV_POLLS_MAX 10
+
+static bool forced = true;
+module_param(forced, bool, 0444);
+MODULE_PARM_DESC(forced, "convert on demand in forced mode, the sensor sleeps in between (default 1), 0: normal mode");
+
+/*
+ * compensation: the 64 bit pressure formula of the datasheet (3.11.3, 1/256 Pa)
+ * or the 32 bit one (8.2, 1 Pa), which needs no 64 bit division on 32 bit ARM.
+ * selftest checks both against the datasheet example at load time and logs
+ * ns / sample, one by one and in batches.
+ */
+static bool pressure_64bit = true;
+module_param(pressure_64bit, bool, 0444);
+MODULE_PARM_DESC(pressure_64bit, "64 bit pressure compensation, 1/256 Pa (default 1), 0: 32 bit, 1 Pa");
+
+static bool selftest;
+module_param(selftest, bool, 0444);
+MODULE_PARM_DESC(selftest, "check and time the compensation against the datasheet example at load (default 0)");
+
+#define BMP280_SELFTEST_BATCH   256
+#define BMP280_SELFTEST_ROUNDS  64
+
+/* continuous acquisition */
+#define BMP280_ODR_MS_MAX       60000
+#define BMP280_RING_SAMPLES     1024    /*power of two*/
+
+static unsigned int odr_ms;
+module_param(odr_ms, uint, 0444);
+MODULE_PARM_DESC(odr_ms, "sampling period of the acquisition thread of every sensor in ms, read() drains the ring (0: one bus read per read(), default)");
+
+/*
+ * records of the acquisition thread. tail counts the records written (free
+ * running, the slot is tail & (BMP280_RING_SAMPLES - 1)), every reader keeps
+ * its own position so that all of them see the whole stream. The records hold
+ * the raw values only, readers compensate what they drain in batches.
+ */
+struct bmp280_ring
+{
+  struct bmp280_record samples[BMP280_RING_SAMPLES];
+  u32 tail;
+  spinlock_t lock;
+  wait_queue_head_t readq;
+  struct task_struct *thread;
+};
+
+/*
+ * last sample, raw values only. Reads younger than max_age_us are served from
+ * here without bus traffic. By default max_age_us is one measurement period
+ * of the configured oversampling and standby, the sensor has no newer data
+ * before that anyway. 0 disables the cache.
+ */
+struct bmp280_cache
+{
+  seqlock_t lock;
+  struct mutex fill_lock;   /*one bus read for all concurrent misses*/
+  struct bmp280_record rec; /*timestamp_ns 0: empty*/
+  u32 max_age_us;
+};
+
+/*
+ * forced mode conversion. started / completed count conversions, one is
+ * running while they differ. A reader arriving then takes it as its ticket
+ * instead of starting another one; the work item publishes one result (or
+ * error) for all of them.
+ */
+struct bmp280_conv
+{
+  struct mutex lock;
+  struct delayed_work work;
+  wait_queue_head_t done;
+  u32 started;
+  u32 completed;
+  unsigned int polls;         /*status polls of the running conversion*/
+  int err;
+  struct bmp280_record rec;
+  u64 conversions;            /*counters under /sys/class/bmp280/<dev>/conversion/*/
+  u64 shared;
+  u64 status_polls;
+};
+
+/* Variables for temperature and pressure calculation */
+struct bmp280_calib
+{
+  int32_t dig_T1, dig_T2, dig_T3;
+  int32_t dig_P1, dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+
+  /*constant terms of the formulas, derived once after reading the block*/
+  int32_t t1x2;               /*dig_T1 << 1*/
+  int32_t p7x16;              /*dig_P7 << 4*/
+  int32_t p4x65536;           /*dig_P4 << 16, 32 bit formula*/
+  s64 p4x2e35;                /*dig_P4 << 35, 64 bit formula*/
+  bool pressure_64bit;
+};
+
+/*
+ * terms of the pressure formula that only depend on t_fine. Temperature
+ * changes slowly, so consecutive samples of a batch mostly share them and
+ * only the division and the final correction run per sample.
+ */
+struct bmp280_pterms
+{
+  int32_t t_fine;
+  s64 var1;                   /*divisor, 0: invalid calibration*/
+  s64 var2;
+};
+
+/*
+ * one sensor. Allocated in probe, freed by bmp280_release with the last
+ * reference of its node: every open file holds the cdev, the cdev holds
+ * the device, so that a file open across remove (or an open racing it)
+ * sees -ENODEV instead of freed memory.
+ */
+struct bmp280_dev
+{
+  struct i2c_client *client;
+  struct drv_core_dev core;           /*minor, cdev, /dev node and file operation statistics*/
+  char name[24];                      /*bmp280-<bus>-<addr>*/
+  u8 ctrl_meas;                       /*mode bits: sleep in forced mode, normal otherwise*/
+  u8 config;                          /*both changed under cache.fill_lock and conv.lock*/
+  bool forced;
+  struct bmp280_calib calib;
+  atomic_t seq;                       /*sequence number of the last record read from the bus*/
+  bool gone;                          /*removed, set under cache.fill_lock and conv.lock*/
+  struct bmp280_cache_stats __percpu *cache_stats;
+  struct bmp280_cache cache;
+  struct bmp280_conv conv;
+  struct iio_dev *indio_dev;          /*NULL without IIO*/
+  struct bmp280_ring ring;
+};
+
+/*per open file state*/
+struct bmp280_file
+{
+  struct bmp280_dev *bmp;
+  bool stream;          /*drains the ring of the acquisition thread*/
+  u32 pos;              /*next sample to hand out*/
+  struct mutex lock;    /*one read() per file at a time*/
+};
+
+/* cache hits and misses, one copy per cpu like the statistics of the core */
+struct bmp280_cache_stats
+{
+  u64_stats_t hits;
+  u64_stats_t misses;
+  struct u64_stats_sync syncp;
+};
+
+/* standby time of config[7:5] in us */
+static const u32 bmp280_standby_us[8] =
+{
+  500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000
+};
+
+/*
+ * @brief oversampling factor of an osrs_t / osrs_p field (0: skipped)
+ */
+static u32 bmp280_osrs(u8 field)
+{
+  return field ? 1 << (min_t(u8, field, 5) - 1) : 0;
+}
+
+/*
+ * @brief max measurement time of one conversion (datasheet 3.8.1)
+ */
+static u32 bmp280_measure_us(u8 ctrl_meas)
+{
+  u32 osrs_t = bmp280_osrs((ctrl_meas >> 5) & 7);
+  u32 osrs_p = bmp280_osrs((ctrl_meas >> 2) & 7);
+
+  return 1250 + 2300 * osrs_t + (osrs_p ? 2300 * osrs_p + 575 : 0);
+}
+
+/*
+ * @brief period of the sensor in normal mode: measurement time plus standby.
+ *        in forced mode the default cache age, so that the standby setting
+ *        still bounds the conversion rate
+ */
+static u32 bmp280_period_us(u8 ctrl_meas, u8 config)
+{
+  return bmp280_measure_us(ctrl_meas) + bmp280_standby_us[config >> 5];
+}
+
+/*
+ * @brief register fields of settings, mode bits of ctrl_meas left 0
+ * @return 0 when OK, -EINVAL for a value the sensor does not have
+ */
+static int bmp280_encode(const struct bmp280_settings *set, u8 *ctrl_meas, u8 *config)
+{
+  u32 osrs_t = set->oversampling_temperature, osrs_p = set->oversampling_pressure;
+  int t_sb;
+
+  if(osrs_t == 0 || osrs_t > 16 || !is_power_of_2(osrs_t) ||
+     osrs_p > 16 || (osrs_p && !is_power_of_2(osrs_p)) ||
+     set->filter == 1 || set->filter > 16 || (set->filter && !is_power_of_2(set->filter)))
+    return -EINVAL;
+
+  for(t_sb = 0; t_sb < ARRAY_SIZE(bmp280_standby_us); t_sb++)
+    if(bmp280_standby_us[t_sb] == set->standby_us)
+      break;
+  if(t_sb == ARRAY_SIZE(bmp280_standby_us))
+    return -EINVAL;
+
+  *ctrl_meas = ((ilog2(osrs_t) + 1) << 5) | ((osrs_p ? ilog2(osrs_p) + 1 : 0) << 2);
+  *config = (t_sb << 5) | ((set->filter ? ilog2(set->filter) : 0) << 2);
+  return 0;
+}
+
+/*
+ * @brief settings in effect, with conversion time and rate
+ */
+static void bmp280_get_settings(struct bmp280_dev *bmp, struct bmp280_settings *set)
+{
+  u8 ctrl_meas, config, filter;
+
+  /*one consistent copy of both registers*/
+  mutex_lock(&bmp->conv.lock);
+  ctrl_meas = bmp->ctrl_meas;
+  config = bmp->config;
+  mutex_unlock(&bmp->conv.lock);
+
+  filter = (config >> 2) & 7;
+  set->oversampling_temperature = bmp280_osrs((ctrl_meas >> 5) & 7);
+  set->oversampling_pressure = bmp280_osrs((ctrl_meas >> 2) & 7);
+  set->filter = filter ? 1 << min_t(u8, filter, 4) : 0;
+  set->standby_us = bmp280_standby_us[config >> 5];
+  set->conversion_us = bmp280_measure_us(ctrl_meas);
+  set->period_us = bmp280_period_us(ctrl_meas, config);
+  set->max_rate_mhz = div_u64(1000000000ULL, set->period_us);
+}
+
+/*
+ * @brief remember a record, its age counts from its timestamp
+ */
+static void bmp280_cache_store(struct bmp280_dev *bmp, const struct bmp280_record *rec)
+{
+  write_seqlock(&bmp->cache.lock);
+  bmp->cache.rec = *rec;
+  write_sequnlock(&bmp->cache.lock);
+}
+
+/*
+ * @brief the cached record, when it is younger than max_age_us
+ */
+static bool bmp280_cache_lookup(struct bmp280_dev *bmp, struct bmp280_record *rec)
+{
+  u32 max_age_us = READ_ONCE(bmp->cache.max_age_us);
+  struct bmp280_record value;
+  unsigned int seq;
+
+  if(max_age_us == 0)
+    return false;
+
+  do
+  {
+    seq = read_seqbegin(&bmp->cache.lock);
+    value = bmp->cache.rec;
+  } while(read_seqretry(&bmp->cache.lock, seq));
+
+  if(value.timestamp_ns == 0 ||
+     ktime_get_ns() - value.timestamp_ns >= (u64)max_age_us * NSEC_PER_USEC)
+    return false;
+
+  *rec = value;
+  rec->status |= BMP280_STATUS_CACHED;
+  return true;
+}
+
+/*
+ * @brief count a cache hit or miss on the local cpu
+ */
+static void bmp280_cache_account(struct bmp280_dev *bmp, bool hit)
+{
+  struct bmp280_cache_stats *st = get_cpu_ptr(bmp->cache_stats);
+
+  u64_stats_update_begin(&st->syncp);
+  u64_stats_inc(hit ? &st->hits : &st->misses);
+  u64_stats_update_end(&st->syncp);
+
+  put_cpu_ptr(bmp->cache_stats);
+}
+
+/*
+ * @brief sum the cache hits or misses over all cpus
+ */
+static u64 bmp280_cache_stats_sum(struct bmp280_dev *bmp, bool hit)
+{
+  u64 sum = 0;
+  int cpu;
+
+  for_each_possible_cpu(cpu)
+  {
+    struct bmp280_cache_stats *st = per_cpu_ptr(bmp->cache_stats, cpu);
+    unsigned int seq;
+    u64 value;
+
+    do
+    {
+      seq = u64_stats_fetch_begin(&st->syncp);
+      value = u64_stats_read(hit ? &st->hits : &st->misses);
+    } while(u64_stats_fetch_retry(&st->syncp, seq));
+
+    sum += value;
+  }
+
+  return sum;
+}
+
+static ssize_t hits_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  return sysfs_emit(buf, "%llu\n", bmp280_cache_stats_sum(drv_core_get_drvdata(dev), true));
+}
+static DEVICE_ATTR_RO(hits);
+
+static ssize_t misses_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  return sysfs_emit(buf, "%llu\n", bmp280_cache_stats_sum(drv_core_get_drvdata(dev), false));
+}
+static DEVICE_ATTR_RO(misses);
+
+static ssize_t max_age_us_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  struct bmp280_dev *bmp = drv_core_get_drvdata(dev);
+
+  return sysfs_emit(buf, "%u\n", READ_ONCE(bmp->cache.max_age_us));
+}
+
+static ssize_t max_age_us_store(struct device *dev, struct device_attribute *attr,
+                                const char *buf, size_t count)
+{
+  struct bmp280_dev *bmp = drv_core_get_drvdata(dev);
+  unsigned int value;
+  int ret = kstrtouint(buf, 0, &value);
+
+  if(ret)
+    return ret;
+
+  WRITE_ONCE(bmp->cache.max_age_us, value);
+  return count;
+}
+static DEVICE_ATTR_RW(max_age_us);
+
+static struct attribute *bmp280_cache_attrs[] =
+{
+  &dev_attr_hits.attr,
+  &dev_attr_misses.attr,
+  &dev_attr_max_age_us.attr,
+  NULL
+};
+
+static const struct attribute_group bmp280_cache_group =
+{
+  .name  = "cache",
+  .attrs = bmp280_cache_attrs
+};
+
+#define BMP280_CONV_ATTR(_name)                                                            \
+  static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+  {                                                                                     \
+    struct bmp280_dev *bmp = drv_core_get_drvdata(dev);                                      \
+    u64 value;                                                                          \
+                                                                                        \
+    mutex_lock(&bmp->conv.lock);                                                        \
+    value = bmp->conv._name;                                                            \
+    mutex_unlock(&bmp->conv.lock);                                                      \
+    return sysfs_emit(buf, "%llu\n", value);                                            \
+  }                                                                                     \
+  static DEVICE_ATTR_RO(_name)
+
+BMP280_CONV_ATTR(conversions);
+BMP280_CONV_ATTR(shared);
+BMP280_CONV_ATTR(status_polls);
+
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  struct bmp280_dev *bmp = drv_core_get_drvdata(dev);
+
+  return sysfs_emit(buf, "%s\n", bmp->forced ? "forced" : "normal");
+}
+static DEVICE_ATTR_RO(mode);
+
+static struct attribute *bmp280_conv_attrs[] =
+{
+  &dev_attr_mode.attr,
+  &dev_attr_conversions.attr,
+  &dev_attr_shared.attr,
+  &dev_attr_status_polls.attr,
+  NULL
+};
+
+static const struct attribute_group bmp280_conv_group =
+{
+  .name  = "conversion",
+  .attrs = bmp280_conv_attrs
+};
+
+/*
+ * @brief start a forced conversion and the work item waiting for it,
+ *        conv.lock held, no conversion running
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_conv_start(struct bmp280_dev *bmp)
+{
+  struct bmp280_conv *c = &bmp->conv;
+  int ret;
+
+  ret = i2c_smbus_write_byte_data(bmp->client, BMP280_REG_CTRL_MEAS,
+                                  (bmp->ctrl_meas & ~BMP280_MODE_MASK) | BMP280_MODE_FORCED);
+  if(ret < 0)
+    return ret;
+
+  c->started++;
+  c->polls = 0;
+  c->conversions++;
+  schedule_delayed_work(&c->work, usecs_to_jiffies(bmp280_measure_us(bmp->ctrl_meas)));
+  return 0;
+}
+
+/*
+ * @brief conversion work: poll the measuring bit without blocking a worker,
+ *        then read the raw result once and complete every waiter with it
+ */
+static void bmp280_conv_work(struct work_struct *work)
+{
+  struct bmp280_conv *c = container_of(to_delayed_work(work), struct bmp280_conv, work);
+  struct bmp280_dev *bmp = container_of(c, struct bmp280_dev, conv);
+  struct bmp280_record rec;
+  int status, ret;
+
+  status = i2c_smbus_read_byte_data(bmp->client, BMP280_REG_STATUS);
+
+  mutex_lock(&c->lock);
+  c->status_polls++;
+  if(status >= 0 && (status & BMP280_MEASURING) && ++c->polls < BMP280_CONV_POLLS_MAX)
+  {
+    mutex_unlock(&c->lock);
+    schedule_delayed_work(&c->work, usecs_to_jiffies(BMP280_CONV_POLL_US));
+    return;
+  }
+  mutex_unlock(&c->lock);
+
+  if(status < 0)
+    ret = status;
+  else if(status & BMP280_MEASURING)
+    ret = -ETIMEDOUT;
+  else
+    ret = read_sample(bmp, &rec);
+
+  if(ret == 0)
+    bmp280_cache_store(bmp, &rec);
+
+  mutex_lock(&c->lock);
+  c->err = ret;
+  if(ret == 0)
+    c->rec = rec;
+  c->completed = c->started;
+  mutex_unlock(&c->lock);
+
+  wake_up_all(&c->done);
+}
+
+/*
+ * @brief one forced conversion: join the running one or start one, sleep
+ *        until the work item completes it
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_forced_sample(struct bmp280_dev *bmp, struct bmp280_record *rec)
+{
+  struct bmp280_conv *c = &bmp->conv;
+  u32 ticket;
+  int ret = 0;
+
+  mutex_lock(&c->lock);
+  if(bmp->gone)
+    ret = -ENODEV;
+  else if(c->started == c->completed)
+    ret = bmp280_conv_start(bmp);
+  else
+    c->shared++;
+  ticket = c->started;
+  mutex_unlock(&c->lock);
+
+  if(ret)
+    return ret;
+
+  if(wait_event_interruptible(c->done, (s32)(READ_ONCE(c->completed) - ticket) >= 0))
+    return -ERESTARTSYS;
+
+  mutex_lock(&c->lock);
+  ret = c->err;
+  if(ret == 0)
+    *rec = c->rec;
+  mutex_unlock(&c->lock);
+
+  return ret;
+}
+
+/*
+ * @brief a new raw sample: forced conversion or, in normal mode, the latest
+ *        result of the sensor
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_measure(struct bmp280_dev *bmp, struct bmp280_record *rec)
+{
+  return bmp->forced ? bmp280_forced_sample(bmp, rec) : read_sample(bmp, rec);
+}
+
+/*
+ * @brief stop the conversion machinery of a removed sensor, fail its waiters
+ */
+static void bmp280_conv_stop(struct bmp280_dev *bmp)
+{
+  struct bmp280_conv *c = &bmp->conv;
+
+  cancel_delayed_work_sync(&c->work);
+
+  mutex_lock(&c->lock);
+  if(c->started != c->completed)
+  {
+    c->err = -ENODEV;
+    c->completed = c->started;
+  }
+  mutex_unlock(&c->lock);
+
+  wake_up_all(&c->done);
+}
+
+/*
+ * @brief reprogram a sensor live. waits for a running forced conversion,
+ *        drops the cached sample of the old settings and resets max_age_us
+ *        to the new period
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_apply(struct bmp280_dev *bmp, const struct bmp280_settings *set)
+{
+  struct bmp280_conv *c = &bmp->conv;
+  u8 ctrl_meas, config;
+  int ret;
+
+  ret = bmp280_encode(set, &ctrl_meas, &config);
+  if(ret)
+    return ret;
+
+  /*no normal mode bus read (fill_lock) and no forced conversion (conv.lock) in between*/
+  mutex_lock(&bmp->cache.fill_lock);
+  mutex_lock(&c->lock);
+  while(c->started != c->completed)
+  {
+    mutex_unlock(&c->lock);
+    wait_event(c->done, READ_ONCE(c->completed) == READ_ONCE(c->started));
+    mutex_lock(&c->lock);
+  }
+
+  if(bmp->gone)
+  {
+    ret = -ENODEV;
+    goto out;
+  }
+
+  /*config is only reliably written in sleep mode*/
+  ret = i2c_smbus_write_byte_data(bmp->client, BMP280_REG_CTRL_MEAS, ctrl_meas | BMP280_MODE_SLEEP);
+  if(ret == 0)
+    ret = i2c_smbus_write_byte_data(bmp->client, BMP280_REG_CONFIG, config);
+  if(ret == 0 && !bmp->forced)
+    ret = i2c_smbus_write_byte_data(bmp->client, BMP280_REG_CTRL_MEAS, ctrl_meas | BMP280_MODE_NORMAL);
+  if(ret)
+    goto out;
+
+  bmp->ctrl_meas = ctrl_meas | (bmp->forced ? BMP280_MODE_SLEEP : BMP280_MODE_NORMAL);
+  bmp->config = config;
+
+  write_seqlock(&bmp->cache.lock);
+  bmp->cache.rec.timestamp_ns = 0;
+  write_sequnlock(&bmp->cache.lock);
+  WRITE_ONCE(bmp->cache.max_age_us, bmp280_period_us(ctrl_meas, config));
+
+out:
+  mutex_unlock(&c->lock);
+  mutex_unlock(&bmp->cache.fill_lock);
+  return ret;
+}
+
+/*
+ * @brief name of the profile matching the settings in effect, NULL for none
+ */
+static int bmp280_current_profile(struct bmp280_dev *bmp)
+{
+  struct bmp280_settings set;
+  int i;
+
+  bmp280_get_settings(bmp, &set);
+  for(i = 0; i < BMP280_PROFILES; i++)
+    if(set.oversampling_temperature == bmp280_profiles[i].oversampling_temperature &&
+       set.oversampling_pressure == bmp280_profiles[i].oversampling_pressure &&
+       set.filter == bmp280_profiles[i].filter &&
+       set.standby_us == bmp280_profiles[i].standby_us)
+      return i;
+  return -1;
+}
+
+/*
+ * settings/profile lists the profiles with the one in effect in brackets
+ * ("[custom]" after a per-field change), writing a name applies it.
+ */
+static ssize_t profile_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  int current_profile = bmp280_current_profile(drv_core_get_drvdata(dev));
+  ssize_t len = 0;
+  int i;
+
+  for(i = 0; i < BMP280_PROFILES; i++)
+    len += sysfs_emit_at(buf, len, i == current_profile ? "[%s] " : "%s ", bmp280_profile_names[i]);
+  if(current_profile < 0)
+    len += sysfs_emit_at(buf, len, "[custom] ");
+  buf[len - 1] = '\n';
+  return len;
+}
+
+static ssize_t profile_store(struct device *dev, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+  int i = sysfs_match_string(bmp280_profile_names, buf);
+  int ret;
+
+  if(i < 0)
+    return i;
+
+  ret = bmp280_apply(drv_core_get_drvdata(dev), &bmp280_profiles[i]);
+  return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(profile);
+
+/*one field of struct bmp280_settings, writable fields reprogram the sensor*/
+#define BMP280_SETTINGS_SHOW(_name)                                                        \
+  static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+  {                                                                                     \
+    struct bmp280_settings set;                                                         \
+                                                                                        \
+    bmp280_get_settings(drv_core_get_drvdata(dev), &set);                                    \
+    return sysfs_emit(buf, "%u\n", set._name);                                          \
+  }
+
+#define BMP280_SETTINGS_ATTR_RW(_name)                                                     \
+  BMP280_SETTINGS_SHOW(_name)                                                           \
+  static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,       \
+                               const char *buf, size_t count)                           \
+  {                                                                                     \
+    struct bmp280_dev *bmp = drv_core_get_drvdata(dev);                                      \
+    struct bmp280_settings set;                                                         \
+    int ret;                                                                            \
+                                                                                        \
+    bmp280_get_settings(bmp, &set);                                                     \
+    ret = kstrtou32(buf, 0, &set._name);                                                \
+    if(ret == 0)                                                                        \
+      ret = bmp280_apply(bmp, &set);                                                    \
+    return ret ? ret : count;                                                           \
+  }                                                                                     \
+  static DEVICE_ATTR_RW(_name)
+
+#define BMP280_SETTINGS_ATTR_RO(_name)                                                     \
+  BMP280_SETTINGS_SHOW(_name)                                                           \
+  static DEVICE_ATTR_RO(_name)
+
+BMP280_SETTINGS_ATTR_RW(oversampling_temperature);
+BMP280_SETTINGS_ATTR_RW(oversampling_pressure);
+BMP280_SETTINGS_ATTR_RW(filter);
+BMP280_SETTINGS_ATTR_RW(standby_us);
+BMP280_SETTINGS_ATTR_RO(conversion_us);
+BMP280_SETTINGS_ATTR_RO(period_us);
+BMP280_SETTINGS_ATTR_RO(max_rate_mhz);
+
+static struct attribute *bmp280_settings_attrs[] =
+{
+  &dev_attr_profile.attr,
+  &dev_attr_oversampling_temperature.attr,
+  &dev_attr_oversampling_pressure.attr,
+  &dev_attr_filter.attr,
+  &dev_attr_standby_us.attr,
+  &dev_attr_conversion_us.attr,
+  &dev_attr_period_us.attr,
+  &dev_attr_max_rate_mhz.attr,
+  NULL
+};
+
+static const struct attribute_group bmp280_settings_group =
+{
+  .name  = "settings",
+  .attrs = bmp280_settings_attrs
+};
+
+static const struct attribute_group *bmp280_groups[] =
+{
+  &drv_core_stats_group,
+  &bmp280_cache_group,
+  &bmp280_conv_group,
+  &bmp280_settings_group,
+  NULL
+};
+
+/*
+ * @brief allocate the per-cpu cache statistics of a sensor
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_cache_stats_init(struct bmp280_dev *bmp)
+{
+  int cpu;
+
+  bmp->cache_stats = alloc_percpu(struct bmp280_cache_stats);
+  if(bmp->cache_stats == NULL)
+    return -ENOMEM;
+
+  for_each_possible_cpu(cpu)
+    u64_stats_init(&per_cpu_ptr(bmp->cache_stats, cpu)->syncp);
+  return 0;
+}
+
+/*
+ * @brief free a sensor with the last reference of its node
+ */
+static void bmp280_release(struct drv_core_dev *cd)
+{
+  struct bmp280_dev *bmp = container_of(cd, struct bmp280_dev, core);
+
+  free_percpu(bmp->cache_stats);
+  kvfree(bmp);
+}
+
+/*
+ * @brief acquisition thread of one sensor, samples every odr_ms on absolute deadlines
+ */
+static int bmp280_sampler(void *data)
+{
+  struct bmp280_dev *bmp = data;
+  struct bmp280_ring *r = &bmp->ring;
+  struct bmp280_record rec;
+  ktime_t next = ktime_get();
+
+  while(!kthread_should_stop())
+  {
+    if(bmp280_measure(bmp, &rec) == 0)
+    {
+      bmp280_cache_store(bmp, &rec);
+
+      spin_lock(&r->lock);
+      r->samples[r->tail & (BMP280_RING_SAMPLES - 1)] = rec;
+      r->tail++;
+      spin_unlock(&r->lock);
+
+      wake_up_interruptible_poll(&r->readq, EPOLLIN | EPOLLRDNORM);
+    }
+
+    /*after a long bus stall start over instead of catching up*/
+    next = ktime_add_ms(next, odr_ms);
+    if(ktime_before(next, ktime_get()))
+      next = ktime_add_ms(ktime_get(), odr_ms);
+
+    set_current_state(TASK_INTERRUPTIBLE);
+    if(!kthread_should_stop())
+      schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+    __set_current_state(TASK_RUNNING);
+  }
+
+  return 0;
+}
+
+/*
+ * @brief compensate and copy as many whole records as fit into the user
+ *        buffer, wait for the first one unless O_NONBLOCK. a reader lapped
+ *        by the thread skips to the oldest record still in the ring, which
+ *        is flagged BMP280_STATUS_GAP
+ * @return bytes copied, negative errno otherwise
+ */
+static ssize_t bmp280_read_samples(struct bmp280_file *bf, struct file *pfile, char __user *pbuff,
+                                   size_t count, struct bmp280_record *last)
+{
+  struct bmp280_dev *bmp = bf->bmp;
+  struct bmp280_ring *r = &bmp->ring;
+  struct bmp280_record batch[16];
+  size_t max = count / sizeof(struct bmp280_record), done = 0;
+  bool gap = false;
+  ssize_t ret = 0;
+
+  if(max == 0)
+    return -EINVAL;
+
+  if(mutex_lock_interruptible(&bf->lock))
+    return -ERESTARTSYS;
+
+  if(READ_ONCE(r->tail) == bf->pos)
+  {
+    if(READ_ONCE(bmp->gone))
+      ret = -ENODEV;
+    else if(pfile->f_flags & O_NONBLOCK)
+      ret = -EAGAIN;
+    else if(wait_event_interruptible(r->readq, READ_ONCE(r->tail) != bf->pos || READ_ONCE(bmp->gone)))
+      ret = -ERESTARTSYS;
+  }
+
+  while(ret == 0 && done < max)
+  {
+    size_t n = 0, copied;
+    u32 pos;
+
+    /*
+     * copy out under the lock in small batches, copy_to_user() may fault.
+     * bf->pos only moves past the records that reached the user, a fault
+     * leaves the rest (and a pending gap) for the next read
+     */
+    spin_lock(&r->lock);
+    pos = bf->pos;
+    if(r->tail - pos > BMP280_RING_SAMPLES)
+    {
+      pos = r->tail - BMP280_RING_SAMPLES;
+      gap = true;
+    }
+    while(n < ARRAY_SIZE(batch) && done + n < max && pos + n != r->tail)
+    {
+      batch[n] = r->samples[(pos + n) & (BMP280_RING_SAMPLES - 1)];
+      n++;
+    }
+    spin_unlock(&r->lock);
+
+    if(n == 0)
+      break;
+
+    compensate_records(&bmp->calib, batch, n);
+    if(gap)
+      batch[0].status |= BMP280_STATUS_GAP;
 
-#define MODULE_NAME "SINGLE_CHAR_I2C_DEVICE"
+    copied = n - DIV_ROUND_UP(copy_to_user(pbuff + done * sizeof(batch[0]), batch, n * sizeof(batch[0])),
+                              sizeof(batch[0]));
+    if(copied < n)
+      ret = -EFAULT;
+    if(copied == 0)
+      break;
 
-/* lets store device number */
-dev_t device_number;
+    bf->pos = pos + copied;
+    done += copied;
+    gap = false;
+    *last = batch[copied - 1];
+  }
 
-/*cdev variable*/
-struct cdev pcdev;
+  mutex_unlock(&bf->lock);
+  if(done == 0 && ret == 0)
+    ret = -ENODEV;    /*woken by remove*/
+  return done ? done * sizeof(struct bmp280_record) : ret;
+}
 
-static struct i2c_adapter *bmp_i2c_adapter = NULL;
-static struct i2c_client *bmp280_i2c_client = NULL;
+/*
+ * @brief compensated record from the cache, from the sensor when the cache
+ *        is too old. concurrent misses wait for one conversion / bus read
+ *        instead of each doing one
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_cached_sample(struct bmp280_dev *bmp, struct bmp280_record *rec)
+{
+  int ret = 0;
 
-/* Defines for device identification */ 
-#define I2C_BUS_AVAILABLE	1	         	/* The I2C Bus available on the raspberry */
-#define SLAVE_DEVICE_NAME	"BMP280"	  /* Device and Driver Name */
-#define BMP280_SLAVE_ADDRESS	0x76		/* BMP280 I2C address */
+  if(bmp280_cache_lookup(bmp, rec))
+  {
+    bmp280_cache_account(bmp, true);
+  }
+  else if(bmp->forced)
+  {
+    /*the conversion scheduler shares one result between all waiters itself*/
+    bmp280_cache_account(bmp, false);
+    ret = bmp280_forced_sample(bmp, rec);
+  }
+  else
+  {
+    mutex_lock(&bmp->cache.fill_lock);
+    if(bmp->gone)
+    {
+      ret = -ENODEV;
+    }
+    else if(bmp280_cache_lookup(bmp, rec))
+    {
+      bmp280_cache_account(bmp, true);
+    }
+    else
+    {
+      bmp280_cache_account(bmp, false);
 
-/* Variables for temperature calculation */
-int32_t dig_T1, dig_T2, dig_T3;
+      ret = read_sample(bmp, rec);
+      if(ret == 0)
+        bmp280_cache_store(bmp, rec);
+    }
+    mutex_unlock(&bmp->cache.fill_lock);
+  }
 
-static const struct i2c_device_id bmp_id[] = {
-  { SLAVE_DEVICE_NAME, 0 }, 
-  { }
-};
+  if(ret == 0)
+    compensate_records(&bmp->calib, rec, 1);
+  return ret;
+}
 
-static struct i2c_driver bmp_driver = {
-	.driver = {
-		.name = SLAVE_DEVICE_NAME,
-		.owner = THIS_MODULE
-	}
+/*
+ * @brief one record, from the cache or one bus read. records are never
+ *        split, the buffer has to hold at least one
+ * @return bytes copied, negative errno otherwise
+ */
+static ssize_t bmp280_read_single(struct bmp280_dev *bmp, char __user *pbuff, size_t count,
+                                  struct bmp280_record *rec)
+{
+  int ret;
+
+  if(count < sizeof(*rec))
+    return -EINVAL;
+
+  /* get temperature and pressure */
+  ret = bmp280_cached_sample(bmp, rec);
+  if(ret)
+  {
+    pr_err("%s: %s %s unable to read the sensor (%d).\n", MODULE_NAME, __func__, bmp->name, ret);
+    return ret;
+  }
+
+  /*copy user data*/
+  if(copy_to_user(pbuff, rec, sizeof(*rec)))
+  {
+    pr_err("%s: %s unable to copy data to user space.\n", MODULE_NAME, __func__);
+    return -EFAULT;
+  }
+
+  return sizeof(*rec);
+}
+
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+/*
+ * IIO front-end. The channels are the fields of struct bmp280_record, the
+ * scan of the triggered buffer is both of them and the timestamp taken in
+ * the trigger's top half. The priv area only holds the sensor, its lifetime
+ * is the one of the sensor: unregistered in remove before the last put.
+ */
+static const struct iio_chan_spec bmp280_iio_channels[] =
+{
+  {
+    .type = IIO_TEMP,
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_SCALE),
+    .scan_index = 0,
+    .scan_type = { .sign = 's', .realbits = 32, .storagebits = 32, .endianness = IIO_CPU },
+  },
+  {
+    .type = IIO_PRESSURE,
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_SCALE),
+    .scan_index = 1,
+    .scan_type = { .sign = 'u', .realbits = 32, .storagebits = 32, .endianness = IIO_CPU },
+  },
+  IIO_CHAN_SOFT_TIMESTAMP(2),
 };
 
-static struct i2c_board_info bmp_i2c_board_info = {
-	I2C_BOARD_INFO(SLAVE_DEVICE_NAME, BMP280_SLAVE_ADDRESS)
+/*
+ * @brief sysfs in_*_raw / in_*_scale. raw comes from the cache or one bus
+ *        read, scale converts to the IIO units (milli degree C, kPa)
+ */
+static int bmp280_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                               int *val, int *val2, long mask)
+{
+  struct bmp280_dev *bmp = *(struct bmp280_dev **)iio_priv(indio_dev);
+  struct bmp280_record rec;
+  int ret;
+
+  switch(mask)
+  {
+  case IIO_CHAN_INFO_RAW:
+    ret = bmp280_cached_sample(bmp, &rec);
+    if(ret)
+      return ret;
+    *val = chan->type == IIO_TEMP ? rec.temperature : rec.pressure;
+    return IIO_VAL_INT;
+
+  case IIO_CHAN_INFO_SCALE:
+    if(chan->type == IIO_TEMP)
+    {
+      *val = 10;          /*1/100 degree*/
+      return IIO_VAL_INT;
+    }
+    *val = 1;             /*Q24.8 Pa*/
+    *val2 = 256 * 1000;
+    return IIO_VAL_FRACTIONAL;
+  }
+
+  return -EINVAL;
+}
+
+static const struct iio_info bmp280_iio_info =
+{
+  .read_raw = bmp280_iio_read_raw,
 };
 
+/*
+ * @brief bottom half of the trigger: one record into the buffer, stamped with
+ *        the time the trigger fired
+ */
+static irqreturn_t bmp280_iio_trigger_handler(int irq, void *p)
+{
+  struct iio_poll_func *pf = p;
+  struct iio_dev *indio_dev = pf->indio_dev;
+  struct bmp280_dev *bmp = *(struct bmp280_dev **)iio_priv(indio_dev);
+  struct bmp280_record rec;
+  struct
+  {
+    s32 temperature;
+    u32 pressure;
+    s64 timestamp __aligned(8);
+  } scan;
+
+  memset(&scan, 0, sizeof(scan));
+  if(bmp280_cached_sample(bmp, &rec) == 0)
+  {
+    scan.temperature = rec.temperature;
+    scan.pressure = rec.pressure;
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan, pf->timestamp);
+  }
+
+  iio_trigger_notify_done(indio_dev->trig);
+  return IRQ_HANDLED;
+}
+
+/*
+ * @brief register the IIO device of a sensor, named like its char device
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_iio_register(struct bmp280_dev *bmp)
+{
+  struct iio_dev *indio_dev;
+  int ret;
+
+  indio_dev = iio_device_alloc(&bmp->client->dev, sizeof(bmp));
+  if(indio_dev == NULL)
+    return -ENOMEM;
+
+  *(struct bmp280_dev **)iio_priv(indio_dev) = bmp;
+  indio_dev->name = bmp->name;
+  indio_dev->info = &bmp280_iio_info;
+  indio_dev->modes = INDIO_DIRECT_MODE;
+  indio_dev->channels = bmp280_iio_channels;
+  indio_dev->num_channels = ARRAY_SIZE(bmp280_iio_channels);
+
+  ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+                                   bmp280_iio_trigger_handler, NULL);
+  if(ret)
+    goto err_free;
+
+  ret = iio_device_register(indio_dev);
+  if(ret)
+    goto err_buffer;
+
+  bmp->indio_dev = indio_dev;
+  return 0;
+
+err_buffer:
+  iio_triggered_buffer_cleanup(indio_dev);
+err_free:
+  iio_device_free(indio_dev);
+  return ret;
+}
+
+/*
+ * @brief unregister the IIO device, waits for running reads / trigger handlers
+ */
+static void bmp280_iio_unregister(struct bmp280_dev *bmp)
+{
+  if(bmp->indio_dev == NULL)
+    return;
+
+  iio_device_unregister(bmp->indio_dev);
+  iio_triggered_buffer_cleanup(bmp->indio_dev);
+  iio_device_free(bmp->indio_dev);
+  bmp->indio_dev = NULL;
+}
+#else
+static int bmp280_iio_register(struct bmp280_dev *bmp)
+{
+  return 0;
+}
+
+static void bmp280_iio_unregister(struct bmp280_dev *bmp)
+{
+}
+#endif
+
 /*-------------------------------------------------------------------*/
 /*define global functions*/
 ssize_t _read(struct file *pfile, char __user *pbuff, size_t count, loff_t *poff)
 {
-  int32_t tmp;
-  int to_copy, not_copied;
+  struct bmp280_file *bf = pfile->private_data;
+  struct bmp280_record rec = { 0 };
+  u64 start, latency;
+  ssize_t ret;
 
-  pr_info("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
 
   if(pbuff == NULL || poff == NULL)
   {
@@ -89,33 +1300,107 @@ ssize_t _read(struct file *pfile, char __user *pbuff, size_t count, loff_t *poff
     return -EINVAL;
   }
 
-  /* get temporature */
-  tmp = read_temperature();
+  start = ktime_get_ns();
+  if(bf->stream)
+    ret = bmp280_read_samples(bf, pfile, pbuff, count, &rec);
+  else
+    ret = bmp280_read_single(bf->bmp, pbuff, count, &rec);
+  latency = ktime_get_ns() - start;
 
-  /* get size of data to copy */
-  to_copy = min(count, sizeof(tmp));
+  drv_core_account(&bf->bmp->core, DRV_STAT_READ, ret, latency);
+  trace_bmp280_read(bf->bmp->core.minor, count, ret, rec.temperature, rec.pressure, latency);
+  return ret;
+}
 
-  /*copy user data*/
-  not_copied = copy_to_user(pbuff, &tmp, to_copy);
+__poll_t _poll(struct file *pfile, poll_table *wait)
+{
+  struct bmp280_file *bf = pfile->private_data;
+  struct bmp280_dev *bmp = bf->bmp;
+
+  /*remove wakes readq in both modes*/
+  poll_wait(pfile, &bmp->ring.readq, wait);
+
+  /*records of the stream still queued at remove can be read*/
+  if(bf->stream && READ_ONCE(bmp->ring.tail) != READ_ONCE(bf->pos))
+    return EPOLLIN | EPOLLRDNORM;
+  if(READ_ONCE(bmp->gone))
+    return EPOLLHUP | EPOLLERR;
+
+  /*a single read is always possible, it just waits for the bus*/
+  return bf->stream ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+long _ioctl(struct file *pfile, unsigned int cmd, unsigned long arg)
+{
+  struct bmp280_file *bf = pfile->private_data;
+  struct bmp280_settings set;
+  __u32 index;
+  int ret;
 
-  if(not_copied != 0)
+  switch(cmd)
   {
-    pr_err("%s: %s unable to copy data to user space.\n", MODULE_NAME, __func__);
-    return EFAULT;
-  }
+    case BMP280_IOC_GET_SETTINGS:
+      bmp280_get_settings(bf->bmp, &set);
+      return copy_to_user((void __user *)arg, &set, sizeof(set)) ? -EFAULT : 0;
+
+    case BMP280_IOC_SET_SETTINGS:
+      if(copy_from_user(&set, (void __user *)arg, sizeof(set)))
+        return -EFAULT;
+      ret = bmp280_apply(bf->bmp, &set);
+      if(ret)
+        return ret;
+      bmp280_get_settings(bf->bmp, &set);
+      return copy_to_user((void __user *)arg, &set, sizeof(set)) ? -EFAULT : 0;
 
-  return to_copy - not_copied;
+    case BMP280_IOC_SET_PROFILE:
+      if(get_user(index, (__u32 __user *)arg))
+        return -EFAULT;
+      if(index >= BMP280_PROFILES)
+        return -EINVAL;
+      return bmp280_apply(bf->bmp, &bmp280_profiles[index]);
+
+    default:
+      return -ENOTTY;
+  }
 }
 
 int _open(struct inode *node, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  struct bmp280_dev *bmp = container_of(node->i_cdev, struct bmp280_dev, core.cdev);
+  struct bmp280_file *bf;
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+
+  bf = kzalloc(sizeof(*bf), GFP_KERNEL);
+  if(bf == NULL)
+    return -ENOMEM;
+
+  /*the file holds the cdev, which keeps the sensor state alive across remove*/
+  bf->bmp = bmp;
+  mutex_init(&bf->lock);
+
+  /*join the acquisition stream at its current end*/
+  if(bmp->ring.thread)
+  {
+    bf->stream = true;
+    bf->pos = READ_ONCE(bmp->ring.tail);
+  }
+  pfile->private_data = bf;
+
+  drv_core_account(&bmp->core, DRV_STAT_OPEN, 0, 0);
+  trace_bmp280_open(bmp->core.minor, pfile->f_flags);
   return 0;
 }
 
 int _release(struct inode *pnode, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  struct bmp280_file *bf = pfile->private_data;
+  struct bmp280_dev *bmp = bf->bmp;
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+  drv_core_account(&bmp->core, DRV_STAT_RELEASE, 0, 0);
+  trace_bmp280_release(bmp->core.minor, pfile->f_flags);
+  kfree(bf);
   return 0;
 }
 
@@ -124,158 +1409,502 @@ struct file_operations pcfops =
 {
   .open    = _open,
   .read    = _read,
+  .poll    = _poll,
+  .unlocked_ioctl = _ioctl,
   .release = _release,
   .owner   = THIS_MODULE
 };
 
-struct class *pdclass;
-struct device *pdevice;
+/*
+ * @brief bind one sensor: identify it, read its calibration, configure it and
+ *        create its character device (and acquisition thread with odr_ms)
+ * @return 0 when OK, negative errno otherwise
+ */
+static int bmp280_probe(struct i2c_client *client, const struct i2c_device_id *id)
+{
+  struct bmp280_dev *bmp;
+  int chip_id, ret;
+
+  pr_info("%s: executing %s for %d-%04x\n", MODULE_NAME, __func__, client->adapter->nr, client->addr);
+
+	/* Read Chip ID */
+  chip_id = i2c_smbus_read_byte_data(client, BMP280_REG_ID);
+  if(chip_id < 0)
+    return chip_id;
+  pr_info("%s: %s ID: 0x%x\n", MODULE_NAME, __func__, chip_id);
+  if(chip_id != 0x56 && chip_id != 0x57 && chip_id != 0x58 && chip_id != 0x60)
+    return -ENODEV;
+
+  /*the ring makes this too large for kmalloc on a fragmented system*/
+  bmp = kvzalloc(sizeof(*bmp), GFP_KERNEL);
+  if(bmp == NULL)
+    return -ENOMEM;
+
+  bmp->client = client;
+  bmp->forced = forced;
+  bmp280_encode(&bmp280_profiles[bmp280_boot_profile], &bmp->ctrl_meas, &bmp->config);
+  bmp->ctrl_meas |= bmp->forced ? BMP280_MODE_SLEEP : BMP280_MODE_NORMAL;
+  snprintf(bmp->name, sizeof(bmp->name), "bmp280-%d-%02x", client->adapter->nr, client->addr);
+  atomic_set(&bmp->seq, 0);
+  seqlock_init(&bmp->cache.lock);
+  mutex_init(&bmp->cache.fill_lock);
+  mutex_init(&bmp->conv.lock);
+  INIT_DELAYED_WORK(&bmp->conv.work, bmp280_conv_work);
+  init_waitqueue_head(&bmp->conv.done);
+  spin_lock_init(&bmp->ring.lock);
+  init_waitqueue_head(&bmp->ring.readq);
+
+  ret = bmp280_cache_stats_init(bmp);
+  if(ret)
+    goto err_free;
+
+	/* Read Calibration Values */
+  ret = read_calibration(bmp);
+  if(ret)
+  {
+    pr_err("%s: %s %s unable to read the calibration\n", MODULE_NAME, __func__, bmp->name);
+    goto err_free;
+  }
+
+	/* Initialice the sensor, sleeping until the first read in forced mode */
+  i2c_smbus_write_byte_data(client, BMP280_REG_CONFIG, bmp->config);
+  i2c_smbus_write_byte_data(client, BMP280_REG_CTRL_MEAS, bmp->ctrl_meas);
+
+  /* Serve reads within one sensor period from the cache */
+  bmp->cache.max_age_us = bmp280_period_us(bmp->ctrl_meas, bmp->config);
+
+  /*1. lowest free minor, cdev and /dev/bmp280-<bus>-<addr> with its sysfs groups*/
+  bmp->core.release = bmp280_release;
+  ret = drv_core_dev_add(&bmp280_core, &bmp->core, &pcfops, &client->dev, bmp, bmp280_groups, "%s", bmp->name);
+  if(ret)
+  {
+    /*the node took bmp along*/
+    pr_err("%s: %s Failed to create the device of %d-%04x\n", MODULE_NAME, __func__, client->adapter->nr, client->addr);
+    return ret;
+  }
+
+  /*2. Start the acquisition thread, one per sensor so that sensors on different buses sample in parallel*/
+  if(odr_ms)
+  {
+    bmp->ring.thread = kthread_run(bmp280_sampler, bmp, "%s", bmp->name);
+    if(IS_ERR(bmp->ring.thread))
+    {
+      pr_err("%s: %s Failed to start the acquisition thread of %s\n", MODULE_NAME, __func__, bmp->name);
+      bmp->ring.thread = NULL;
+    }
+  }
+
+  /*3. IIO front-end, the char device works without it*/
+  ret = bmp280_iio_register(bmp);
+  if(ret)
+    pr_err("%s: %s Failed to register the IIO device of %s (%d)\n", MODULE_NAME, __func__, bmp->name, ret);
+
+  i2c_set_clientdata(client, bmp);
+  pr_info("%s: %s /dev/%s created successfully..\n", MODULE_NAME, __func__, bmp->name);
+  return 0;
+
+err_free:
+  free_percpu(bmp->cache_stats);
+  kvfree(bmp);
+  return ret;
+}
+
+/*
+ * @brief unbind one sensor. open files keep the state until they are closed,
+ *        their reads fail with -ENODEV
+ */
+static int bmp280_remove(struct i2c_client *client)
+{
+  struct bmp280_dev *bmp = i2c_get_clientdata(client);
+
+  pr_info("%s: executing %s for %s\n", MODULE_NAME, __func__, bmp->name);
+
+  bmp280_iio_unregister(bmp);
+  if(bmp->ring.thread)
+    kthread_stop(bmp->ring.thread);
+
+  /*no bus access after this*/
+  mutex_lock(&bmp->cache.fill_lock);
+  mutex_lock(&bmp->conv.lock);
+  WRITE_ONCE(bmp->gone, true);
+  mutex_unlock(&bmp->conv.lock);
+  mutex_unlock(&bmp->cache.fill_lock);
+  bmp280_conv_stop(bmp);
+  wake_up_interruptible_poll(&bmp->ring.readq, EPOLLHUP | EPOLLERR);
+
+  /*bmp280_release frees the sensor once the last open file is closed*/
+  drv_core_dev_del(&bmp->core);
+  return 0;
+}
+
+static const struct i2c_device_id bmp_id[] = {
+  { SLAVE_DEVICE_NAME, 0 },
+  { }
+};
+MODULE_DEVICE_TABLE(i2c, bmp_id);
+
+static const struct of_device_id bmp_of_match[] = {
+  { .compatible = "bosch,bmp280" },
+  { }
+};
+MODULE_DEVICE_TABLE(of, bmp_of_match);
+
+static struct i2c_driver bmp_driver = {
+	.driver = {
+		.name = SLAVE_DEVICE_NAME,
+		.of_match_table = bmp_of_match,
+		.owner = THIS_MODULE
+	},
+	.probe = bmp280_probe,
+	.remove = bmp280_remove,
+	.id_table = bmp_id
+};
 
 /*-------------------------------------------------------------------*/
 /*define static functions*/
 /*-------------------------------------------------------------------*/
 /**
- * @brief Read current temperature from BMP280 sensor
- * @return temperature in degree
+ * @brief Read one raw sample of temperature and pressure from BMP280 sensor,
+ *        compensate_records() fills in the values where it is handed out.
+ *        pressure and temperature come in one burst of 0xF7..0xFC: one bus
+ *        transaction instead of one per byte, and the sensor's shadow
+ *        registers keep MSB / LSB / XLSB of one burst from the same conversion
+ * @return 0 when OK, negative errno otherwise
  */
-static int32_t  read_temperature(void) {
-	int32_t  var1, var2;
-	int32_t  raw_temp;
-	int32_t  d1, d2, d3;
+static int read_sample(struct bmp280_dev *bmp, struct bmp280_record *rec) {
+	int ret;
+
+	rec->timestamp_ns = ktime_get_ns();
+	ret = read_raw(bmp, &rec->raw_temperature, &rec->raw_pressure);
+	if(ret)
+		return ret;
+
+	rec->seq = atomic_inc_return(&bmp->seq);
+	rec->status = 0;
+	return 0;
+}
 
-	/* Read Temperature */
-	d1 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFA);
-	d2 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFB);
-	d3 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFC);
-	raw_temp = ((d1<<16) | (d2<<8) | d3) >> 4;
+/**
+ * @brief burst read of the raw 20 bit pressure and temperature
+ * @return 0 when OK, negative errno otherwise
+ */
+static int read_raw(struct bmp280_dev *bmp, int32_t *raw_temp, int32_t *raw_press) {
+	u8 data[BMP280_DATA_LEN];
+	int ret;
 
-	/* Calculate temperature in degree */
-	var1 = ((((raw_temp >> 3) - (dig_T1 << 1))) * (dig_T2)) >> 11;
+	/* Read Pressure and Temperature */
+	ret = i2c_smbus_read_i2c_block_data(bmp->client, BMP280_REG_DATA, sizeof(data), data);
+	if(ret < 0)
+		return ret;
+	if(ret != sizeof(data))
+		return -EIO;
 
-	var2 = (((((raw_temp >> 4) - (dig_T1)) * ((raw_temp >> 4) - (dig_T1))) >> 12) * (dig_T3)) >> 14;
-	return ((var1 + var2) *5 +128) >> 8;
+	*raw_press = ((data[0]<<16) | (data[1]<<8) | data[2]) >> 4;
+	*raw_temp = ((data[3]<<16) | (data[4]<<8) | data[5]) >> 4;
+	return 0;
 }
 
 /**
- * @brief this function is called, when the module is loaded into the kernel
- * @return 0 when module init OK, non-zero otherwise
+ * @brief read the calibration block 0x88..0x9F in one burst
+ * @return 0 when OK, negative errno otherwise
  */
-static int __init ModuleCharacterDeviceInit(void)
+static int read_calibration(struct bmp280_dev *bmp) {
+	struct bmp280_calib *c = &bmp->calib;
+	u8 calib[BMP280_CALIB_LEN];
+	int ret;
+
+	ret = i2c_smbus_read_i2c_block_data(bmp->client, BMP280_REG_CALIB, sizeof(calib), calib);
+	if(ret < 0)
+		return ret;
+	if(ret != sizeof(calib))
+		return -EIO;
+
+	/* dig_T1 and dig_P1 are unsigned, all others signed 16 bit */
+	c->dig_T1 = get_unaligned_le16(&calib[0]);
+	c->dig_T2 = (s16)get_unaligned_le16(&calib[2]);
+	c->dig_T3 = (s16)get_unaligned_le16(&calib[4]);
+	c->dig_P1 = get_unaligned_le16(&calib[6]);
+	c->dig_P2 = (s16)get_unaligned_le16(&calib[8]);
+	c->dig_P3 = (s16)get_unaligned_le16(&calib[10]);
+	c->dig_P4 = (s16)get_unaligned_le16(&calib[12]);
+	c->dig_P5 = (s16)get_unaligned_le16(&calib[14]);
+	c->dig_P6 = (s16)get_unaligned_le16(&calib[16]);
+	c->dig_P7 = (s16)get_unaligned_le16(&calib[18]);
+	c->dig_P8 = (s16)get_unaligned_le16(&calib[20]);
+	c->dig_P9 = (s16)get_unaligned_le16(&calib[22]);
+	c->pressure_64bit = pressure_64bit;
+	derive_calibration(c);
+	return 0;
+}
+
+/**
+ * @brief constant terms of the compensation, after the dig_* values are set
+ */
+static void derive_calibration(struct bmp280_calib *c) {
+	c->t1x2 = c->dig_T1 << 1;
+	c->p7x16 = c->dig_P7 << 4;
+	c->p4x65536 = c->dig_P4 << 16;
+	c->p4x2e35 = (s64)c->dig_P4 << 35;
+}
+
+/**
+ * @brief Bosch integer compensation of a raw temperature
+ * @return temperature in 1/100 degree, t_fine for the pressure compensation
+ */
+static int32_t compensate_temperature(const struct bmp280_calib *c, int32_t raw_temp, int32_t *t_fine) {
+	int32_t var1, var2, dt;
+
+	var1 = (((raw_temp >> 3) - c->t1x2) * c->dig_T2) >> 11;
+	dt = (raw_temp >> 4) - c->dig_T1;
+	var2 = (((dt * dt) >> 12) * c->dig_T3) >> 14;
+	*t_fine = var1 + var2;
+	return (*t_fine * 5 + 128) >> 8;
+}
+
+/**
+ * @brief t_fine dependent terms of the 64 bit (datasheet 3.11.3) or 32 bit
+ *        (datasheet 8.2) pressure formula
+ */
+static void compensate_pressure_terms(const struct bmp280_calib *c, int32_t t_fine, struct bmp280_pterms *pt) {
+	pt->t_fine = t_fine;
+
+	if(c->pressure_64bit) {
+		s64 var1 = (s64)t_fine - 128000, var2;
+
+		var2 = var1 * var1 * c->dig_P6;
+		var2 = var2 + ((var1 * c->dig_P5) << 17);
+		var2 = var2 + c->p4x2e35;
+		var1 = ((var1 * var1 * c->dig_P3) >> 8) + ((var1 * c->dig_P2) << 12);
+		pt->var1 = ((((s64)1 << 47) + var1) * c->dig_P1) >> 33;
+		pt->var2 = var2;
+	} else {
+		int32_t var1 = (t_fine >> 1) - 64000, var2;
+
+		var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * c->dig_P6;
+		var2 = var2 + ((var1 * c->dig_P5) << 1);
+		var2 = (var2 >> 2) + c->p4x65536;
+		var1 = (((c->dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((c->dig_P2 * var1) >> 1)) >> 18;
+		pt->var1 = ((32768 + var1) * c->dig_P1) >> 15;
+		pt->var2 = var2;
+	}
+}
+
+/**
+ * @brief pressure of one raw sample with the terms of its t_fine
+ * @return pressure in Pa as Q24.8 (1 Pa steps with the 32 bit formula),
+ *         0 for an invalid calibration
+ */
+static uint32_t compensate_pressure(const struct bmp280_calib *c, const struct bmp280_pterms *pt, int32_t raw_press) {
+	if(pt->var1 == 0)
+		return 0;	/* avoid a division by zero */
+
+	if(c->pressure_64bit) {
+		s64 p, var1, var2;
+
+		p = 1048576 - raw_press;
+		p = div64_s64(((p << 31) - pt->var2) * 3125, pt->var1);
+		var1 = ((s64)c->dig_P9 * (p >> 13) * (p >> 13)) >> 25;
+		var2 = ((s64)c->dig_P8 * p) >> 19;
+		p = ((p + var1 + var2) >> 8) + c->p7x16;
+		return (uint32_t)p;
+	} else {
+		uint32_t p, var1 = (uint32_t)pt->var1;
+		int32_t v1, v2;
+
+		p = ((uint32_t)(1048576 - raw_press) - (uint32_t)((int32_t)pt->var2 >> 12)) * 3125;
+		if(p < 0x80000000)
+			p = (p << 1) / var1;
+		else
+			p = (p / var1) * 2;
+		v1 = (c->dig_P9 * (int32_t)(((p >> 3) * (p >> 3)) >> 13)) >> 12;
+		v2 = ((int32_t)(p >> 2) * c->dig_P8) >> 13;
+		p = (uint32_t)((int32_t)p + ((v1 + v2 + c->dig_P7) >> 4));
+		return p << 8;
+	}
+}
+
+/**
+ * @brief compensate n records in place from their raw_temperature and
+ *        raw_pressure: temperature, pressure and BMP280_STATUS_NO_PRESSURE.
+ *        the pressure terms are recomputed only when t_fine changes
+ */
+static void compensate_records(const struct bmp280_calib *c, struct bmp280_record *rec, size_t n) {
+	struct bmp280_pterms pt;
+	bool have_terms = false;
+	int32_t t_fine;
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+		rec[i].temperature = compensate_temperature(c, rec[i].raw_temperature, &t_fine);
+
+		/* pressure compensation depends on t_fine of the same burst */
+		if(rec[i].raw_pressure == BMP280_RAW_SKIPPED) {
+			rec[i].pressure = 0;
+			rec[i].status |= BMP280_STATUS_NO_PRESSURE;
+			continue;
+		}
+
+		if(!have_terms || pt.t_fine != t_fine) {
+			compensate_pressure_terms(c, t_fine, &pt);
+			have_terms = true;
+		}
+		rec[i].pressure = compensate_pressure(c, &pt, rec[i].raw_pressure);
+	}
+}
+
+/**
+ * @brief check both pressure formulas against the datasheet example
+ *        (25.08 C, 100653.25 Pa / 100656 Pa) and log the time per sample,
+ *        one record per call as on a read and a batch per call
+ * @return 0 when OK, -EINVAL when a result differs
+ */
+static int compensate_selftest(void) {
+	static const struct {
+		bool pressure_64bit;
+		uint32_t pressure;
+	} paths[] = {
+		{ true, 25767233 },
+		{ false, 100656 << 8 },
+	};
+	struct bmp280_calib c = {
+		.dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+		.dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+		.dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+	};
+	struct bmp280_record *rec;
+	int i, j, round, ret = 0;
+
+	rec = kvmalloc_array(BMP280_SELFTEST_BATCH, sizeof(*rec), GFP_KERNEL);
+	if(rec == NULL)
+		return -ENOMEM;
+
+	derive_calibration(&c);
+	for(i = 0; i < ARRAY_SIZE(paths); i++) {
+		u64 single_ns, batch_ns, start;
+
+		c.pressure_64bit = paths[i].pressure_64bit;
+
+		/* the datasheet sample, then a slow temperature and pressure drift */
+		for(j = 0; j < BMP280_SELFTEST_BATCH; j++) {
+			rec[j].raw_temperature = 519888 + j / 16;
+			rec[j].raw_pressure = 415148 + j;
+			rec[j].status = 0;
+		}
+
+		compensate_records(&c, rec, 1);
+		if(rec[0].temperature != 2508 || rec[0].pressure != paths[i].pressure) {
+			pr_err("%s: %s %d bit: temperature %d pressure %u, expected 2508 %u\n", MODULE_NAME, __func__,
+			       paths[i].pressure_64bit ? 64 : 32, rec[0].temperature, rec[0].pressure, paths[i].pressure);
+			ret = -EINVAL;
+			continue;
+		}
+
+		start = ktime_get_ns();
+		for(round = 0; round < BMP280_SELFTEST_ROUNDS; round++)
+			for(j = 0; j < BMP280_SELFTEST_BATCH; j++)
+				compensate_records(&c, &rec[j], 1);
+		single_ns = ktime_get_ns() - start;
+
+		start = ktime_get_ns();
+		for(round = 0; round < BMP280_SELFTEST_ROUNDS; round++)
+			compensate_records(&c, rec, BMP280_SELFTEST_BATCH);
+		batch_ns = ktime_get_ns() - start;
+
+		pr_info("%s: %s %d bit pressure OK, %llu ns / sample one by one, %llu ns / sample in batches of %d\n",
+		        MODULE_NAME, __func__, paths[i].pressure_64bit ? 64 : 32,
+		        div_u64(single_ns, BMP280_SELFTEST_ROUNDS * BMP280_SELFTEST_BATCH),
+		        div_u64(batch_ns, BMP280_SELFTEST_ROUNDS * BMP280_SELFTEST_BATCH), BMP280_SELFTEST_BATCH);
+	}
+
+	kvfree(rec);
+	return ret;
+}
+
+/**
+ * @brief instantiate the sensors of the sensors= parameter, the driver
+ *        core probes them. a bad entry is reported and skipped
+ */
+static void bmp280_instantiate(void)
 {
-	u8 id;
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  int i;
 
-  /*1. dynamically allocate a device number (creates device number)*/
-  if(alloc_chrdev_region(&device_number, 0 /*first minor*/, 1 /*counts*/, "pdevice") < 0)
+  for(i = 0; i < nr_sensors; i++)
   {
-    pr_err("%s: %s Failed to allocate a major number\n", MODULE_NAME, __func__);
-    return -1;
-  }
+    struct i2c_board_info info = { I2C_BOARD_INFO(SLAVE_DEVICE_NAME, 0) };
+    struct i2c_adapter *adapter;
+    struct i2c_client *client;
+    unsigned int bus, addr;
 
-  pr_info("%s: %s device number <major>:<minor> = %d:%d\n", MODULE_NAME, __func__,
-                                                      MAJOR(device_number),
-                                                      MINOR(device_number));
-
-  /*
-    - The Virtual Filesystem (also known as Virtual Filesystem Switch or VFS) is a
-      kernel software layer that handles all system calls related to a standard Unix
-      filesystem. Its main strength is providing a common interface to several kinds
-      of filesystems.
-
-    - The Virtual File System (VFS) layer [1] provides a uniform interface for the
-      kernel to deal with various I/O requests and specifies a standard interface
-      that each file system must support.
-  */
- 
-  /*2. create device class under /sys/class/ */
-  pdclass = class_create(THIS_MODULE, "pdevclass");
-  if (IS_ERR(pdclass))
-  {
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to register device class\n", MODULE_NAME, __func__);
-    return PTR_ERR(pdclass);
-  }
+    if(sscanf(sensors[i], "%u:%x", &bus, &addr) != 2 || addr > 0x7f)
+    {
+      pr_err("%s: %s invalid sensor \"%s\", expected <bus>:<addr>\n", MODULE_NAME, __func__, sensors[i]);
+      continue;
+    }
 
-  /*3. Create the device file in /dev and set the permissions to 0666 */
-  pdevice = device_create(pdclass, NULL, device_number, NULL, "pdev");
-  if(pdevice == NULL)
-  {
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
-    return -1;
-  }
+    adapter = i2c_get_adapter(bus);
+    if(adapter == NULL)
+    {
+      pr_err("%s: %s unable to get i2c adaptor %u...\n", MODULE_NAME, __func__, bus);
+      continue;
+    }
 
-  /*4. Initialize the character device and add it to the system*/
-  cdev_init(&pcdev, &pcfops);
-  pcdev.owner = THIS_MODULE;
+    info.addr = addr;
+    client = i2c_new_client_device(adapter, &info);
+    i2c_put_adapter(adapter);
+    if(IS_ERR(client))
+    {
+      pr_err("%s: %s unable to get i2c device %s...\n", MODULE_NAME, __func__, sensors[i]);
+      continue;
+    }
 
-  /*5. register a device (cdev structure) with VFS*/  
-  if(cdev_add(&pcdev, device_number, 1) < 0)
-  {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to add the cdev\n", MODULE_NAME, __func__);
-    return -1;
+    bmp280_clients[i] = client;
   }
+}
 
-  bmp_i2c_adapter = i2c_get_adapter(I2C_BUS_AVAILABLE);
-  if(bmp_i2c_adapter == NULL)
-  {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_info("%s: %s unable to get i2c adaptor...\n", MODULE_NAME, __func__);
-    return -1;
-  }
+/**
+ * @brief this function is called, when the module is loaded into the kernel
+ * @return 0 when module init OK, non-zero otherwise
+ */
+static int __init ModuleCharacterDeviceInit(void)
+{
+  int ret;
+
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+
+  odr_ms = min(odr_ms, BMP280_ODR_MS_MAX);
 
-  bmp280_i2c_client = i2c_new_client_device(bmp_i2c_adapter, &bmp_i2c_board_info);
-  if(bmp280_i2c_client == NULL)
+  bmp280_boot_profile = match_string(bmp280_profile_names, BMP280_PROFILES, profile);
+  if(bmp280_boot_profile < 0)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_info("%s: %s unable to get i2c device...\n", MODULE_NAME, __func__);
-    return -1;
+    pr_err("%s: %s unknown profile \"%s\"\n", MODULE_NAME, __func__, profile);
+    return -EINVAL;
   }
 
-  if(i2c_add_driver(&bmp_driver) == -1)
+  if(selftest)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    i2c_unregister_device(bmp280_i2c_client);
-    pr_info("%s: %s Can't add driver...\n", MODULE_NAME, __func__);
-    return -1;
+    ret = compensate_selftest();
+    if(ret)
+      return ret;
   }
 
-  pr_info("%s: %s BMP280 Driver added!\n", MODULE_NAME, __func__);
+  /*1. device numbers, one minor per sensor, and /sys/class/bmp280/ */
+  ret = drv_core_register(&bmp280_core, THIS_MODULE, "bmp280", BMP280_MAX_DEVICES);
+  if(ret)
+    return ret;
 
-  if (bmp280_i2c_client == NULL)
+  /*2. register the driver, it probes every matching sensor*/
+  ret = i2c_add_driver(&bmp_driver);
+  if(ret)
   {
-    pr_err("%s: %s I2C client not initialized properly\n", MODULE_NAME, __func__);
-    return -ENODEV;
+    drv_core_unregister(&bmp280_core);
+    pr_info("%s: %s Can't add driver...\n", MODULE_NAME, __func__);
+    return ret;
   }
 
-	/* Read Chip ID */
-	id = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xD0);
-	pr_info("%s: %s ID: 0x%x\n", MODULE_NAME, __func__, id);
-
-	/* Read Calibration Values */
-  dig_T1 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x88);
-  dig_T2 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x8a);
-  dig_T3 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x8c);
-
-  if(dig_T2 > 32767) dig_T2 -= 65536;
-
-	if(dig_T3 > 32767) dig_T3 -= 65536;
-
-	/* Initialice the sensor */
-  i2c_smbus_write_byte_data(bmp280_i2c_client, 0xf5, 5<<5);
-  i2c_smbus_write_byte_data(bmp280_i2c_client, 0xf4, ((5<<5) | (5<<2) | (3<<0)));
+  pr_info("%s: %s BMP280 Driver added!\n", MODULE_NAME, __func__);
 
-  pr_info("%s: %s device created successfully..\n", MODULE_NAME, __func__);
+  /*3. sensors without a device tree node*/
+  bmp280_instantiate();
 
   return 0;
 }
@@ -285,16 +1914,16 @@ static int __init ModuleCharacterDeviceInit(void)
  */
 static void __exit ModuleCharacterDeviceExit(void)
 {
+  int i;
+
   pr_info("%s: executing %s\n", MODULE_NAME, __func__);
-  
-  /*cleanup task*/
-  i2c_put_adapter(bmp_i2c_adapter);
-  i2c_unregister_device(bmp280_i2c_client);
+
+  /*cleanup task: unregistering a client removes its sensor*/
+  for(i = 0; i < BMP280_MAX_DEVICES; i++)
+    if(bmp280_clients[i])
+      i2c_unregister_device(bmp280_clients[i]);
 	i2c_del_driver(&bmp_driver);
-  device_destroy(pdclass, device_number);
-  class_destroy(pdclass);
-  cdev_del(&pcdev);
-  unregister_chrdev_region(device_number, 1);
+  drv_core_unregister(&bmp280_core);
 
   pr_info("%s: %s device cleaned up successfully..\n", MODULE_NAME, __func__);
 }
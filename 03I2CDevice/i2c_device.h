@@ -0,0 +1,82 @@
+/************************************************************
+ *  i2c_device.h - Shared definitions of /dev/bmp280-<bus>-<addr>
+ *
+ *  Description:
+ *      Layout of the records returned by read() on /dev/bmp280-<bus>-<addr>.
+ *      This header is included by the driver and by user space.
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#ifndef I2C_DEVICE_H
+#define I2C_DEVICE_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * one sample of both channels, the record returned by read(). Fixed size,
+ * naturally aligned, so a buffer of records can be used as an array.
+ * seq numbers the bus reads of the driver, a gap means samples were missed.
+ */
+struct bmp280_record
+{
+  __u64 timestamp_ns;     /*CLOCK_MONOTONIC, just before the burst read*/
+  __u32 seq;
+  __u32 status;           /*BMP280_STATUS_* */
+  __s32 temperature;      /*1/100 degree C*/
+  __u32 pressure;         /*Pa in Q24.8 (value / 256 = Pa), whole Pa with pressure_64bit=0*/
+  __s32 raw_temperature;  /*20 bit ADC values*/
+  __s32 raw_pressure;
+};
+
+#define BMP280_STATUS_CACHED       0x1  /*served from the sample cache, no bus read*/
+#define BMP280_STATUS_NO_PRESSURE  0x2  /*pressure measurement skipped (osrs_p = 0), pressure is 0*/
+#define BMP280_STATUS_GAP          0x4  /*records before this one were lost (reader lapped)*/
+
+/*
+ * measurement settings of a sensor, BMP280_IOC_GET_SETTINGS /
+ * BMP280_IOC_SET_SETTINGS or /sys/class/bmp280/<dev>/settings/.
+ *   oversampling_temperature  1, 2, 4, 8, 16 (pressure compensation needs it)
+ *   oversampling_pressure     0 (skipped), 1, 2, 4, 8, 16
+ *   filter                    IIR coefficient 0 (off), 2, 4, 8, 16
+ *   standby_us                500, 62500, 125000, 250000, 500000, 1000000,
+ *                             2000000, 4000000
+ * conversion_us, period_us and max_rate_mhz are computed by the driver (and
+ * ignored by SET): max time of one conversion, time between two new samples
+ * (conversion plus standby) and 1e9 / period_us, new samples per 1000 s.
+ */
+struct bmp280_settings
+{
+  __u32 oversampling_temperature;
+  __u32 oversampling_pressure;
+  __u32 filter;
+  __u32 standby_us;
+  __u32 conversion_us;
+  __u32 period_us;
+  __u32 max_rate_mhz;
+};
+
+/* named settings for BMP280_IOC_SET_PROFILE, the profile= module parameter and settings/profile */
+enum bmp280_profile
+{
+  BMP280_PROFILE_DEFAULT,       /*16x / 16x, filter off, 1 s standby*/
+  BMP280_PROFILE_LOW_LATENCY,   /*1x / 1x, filter off, 0.5 ms standby*/
+  BMP280_PROFILE_LOW_POWER,     /*1x / 1x, filter off, 4 s standby*/
+  BMP280_PROFILE_STANDARD,      /*1x T / 4x P, filter 4, 62.5 ms standby*/
+  BMP280_PROFILE_LOW_NOISE,     /*2x T / 16x P, filter 16, 0.5 ms standby*/
+  BMP280_PROFILES
+};
+
+#define BMP280_IOC_MAGIC 'b'
+
+#define BMP280_IOC_GET_SETTINGS _IOR(BMP280_IOC_MAGIC, 1, struct bmp280_settings)
+/*reprograms the sensor, returns the settings in effect*/
+#define BMP280_IOC_SET_SETTINGS _IOWR(BMP280_IOC_MAGIC, 2, struct bmp280_settings)
+#define BMP280_IOC_SET_PROFILE  _IOW(BMP280_IOC_MAGIC, 3, __u32)
+
+#endif /* I2C_DEVICE_H */
@@ -0,0 +1,92 @@
+/************************************************************
+ *  i2c_device_trace.h - Tracepoints of the BMP280 device
+ *
+ *  Description:
+ *      open / read / release tracepoints of the BMP280 driver.
+ *      They cost a static branch when disabled.
+ *
+ *  Usage:
+ *      - trace-cmd record -e i2c_device
+ *      - perf record -e 'i2c_device:*'
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM i2c_device
+
+#if !defined(_I2C_DEVICE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _I2C_DEVICE_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(bmp280_file,
+
+  TP_PROTO(unsigned int minor, unsigned int flags),
+
+  TP_ARGS(minor, flags),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, minor)
+    __field(unsigned int, flags)
+  ),
+
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->flags = flags;
+  ),
+
+  TP_printk("minor=%u flags=0x%x", __entry->minor, __entry->flags)
+);
+
+DEFINE_EVENT(bmp280_file, bmp280_open,
+  TP_PROTO(unsigned int minor, unsigned int flags),
+  TP_ARGS(minor, flags)
+);
+
+DEFINE_EVENT(bmp280_file, bmp280_release,
+  TP_PROTO(unsigned int minor, unsigned int flags),
+  TP_ARGS(minor, flags)
+);
+
+TRACE_EVENT(bmp280_read,
+
+  TP_PROTO(unsigned int minor, size_t requested, ssize_t ret, s32 temperature, u32 pressure, u64 latency_ns),
+
+  TP_ARGS(minor, requested, ret, temperature, pressure, latency_ns),
+
+  TP_STRUCT__entry(
+    __field(unsigned int, minor)
+    __field(size_t, requested)
+    __field(ssize_t, ret)
+    __field(s32, temperature)
+    __field(u32, pressure)
+    __field(u64, latency_ns)
+  ),
+
+  TP_fast_assign(
+    __entry->minor = minor;
+    __entry->requested = requested;
+    __entry->ret = ret;
+    __entry->temperature = temperature;
+    __entry->pressure = pressure;
+    __entry->latency_ns = latency_ns;
+  ),
+
+  TP_printk("minor=%u requested=%zu ret=%zd temperature=%d pressure=%u latency_ns=%llu",
+            __entry->minor, __entry->requested, __entry->ret, __entry->temperature,
+            __entry->pressure, __entry->latency_ns)
+);
+
+#endif /* _I2C_DEVICE_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE i2c_device_trace
+#include <trace/define_trace.h>
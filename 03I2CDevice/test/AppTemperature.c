@@ -1,58 +1,127 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "bmp280_reader.h"
 
-#define DEVICE_PATH "/dev/pdev"
-#define SLEEP_DURATION 10 // Sleep duration in seconds
-#define BUFFER_SIZE 128
+#define DEVICE_PATH "/dev/bmp280-1-76"
+#define IDLE_TIMEOUT_MS 5000       // Stop after this long without a record
+#define OUTPUT_BUFFER (1 << 20)    // stdout is flushed in blocks of this size
 
-int write_timestamp(char *buffer, size_t buffer_size) {
-    time_t rawtime;
-    struct tm *timeinfo;
+struct output {
+    int binary;
+    unsigned long limit;           // Records per sensor to write, 0: until SIGINT
+    unsigned long written[BMP280_READER_MAX_SENSORS];
+};
 
-    // Get current time
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);  // Convert to local time format
+static volatile sig_atomic_t stop;
 
-    // Write formatted time into buffer
-    return strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", timeinfo);
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
 }
 
-int main() {
-    int fd;
-    char buffer[BUFFER_SIZE];
+// One batch of one sensor: CSV lines or tagged binary records
+static void write_records(struct bmp280_reader *r, int sensor, const struct bmp280_record *rec,
+                          size_t n, void *arg) {
+    struct output *out = arg;
 
-    // Open the /dev/pdev device file
-    fd = open(DEVICE_PATH, O_RDWR);
-    if (fd == -1) {
-        perror("Failed to open /dev/pdev");
-        return EXIT_FAILURE;
+    if (out->limit && out->written[sensor] + n > out->limit)
+        n = out->limit - out->written[sensor];
+    out->written[sensor] += n;
+
+    for (size_t i = 0; i < n; i++) {
+        if (out->binary) {
+            struct bmp280_tagged_record t = { .sensor = sensor, .rec = rec[i] };
+            fwrite(&t, sizeof(t), 1, stdout);
+            continue;
+        }
+
+        struct timespec ts = bmp280_reader_realtime(r, rec[i].timestamp_ns);
+        printf("%d,%u,%lld.%09ld,%.2f,%.2f,%u\n", sensor, rec[i].seq, (long long)ts.tv_sec, ts.tv_nsec,
+               rec[i].temperature / 100.0, rec[i].pressure / 256.0, rec[i].status);
     }
+}
+
+static int done(const struct bmp280_reader *r, const struct output *out) {
+    if (stop)
+        return 1;
+    if (!out->limit)
+        return 0;
+    for (int i = 0; i < r->nr_sensors; i++)
+        if (out->written[i] < out->limit)
+            return 0;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    static struct bmp280_reader reader;
+    struct output out = { 0 };
+    const char *default_path = DEVICE_PATH;
+    int opt, ret = EXIT_SUCCESS;
 
-    // Loop 10 times to write 1, sleep, then write 0, sleep
-    for (int i = 0; i < 10; i++) {
-        // read from the device
-        int read_buffer;
-        if (read(fd, &read_buffer, sizeof(int32_t)) == -1) {
-            perror("Failed to read /dev/pdev");
-            close(fd);
+    while ((opt = getopt(argc, argv, "bn:")) != -1) {
+        switch (opt) {
+        case 'b':
+            out.binary = 1;
+            break;
+        case 'n':
+            out.limit = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b] [-n records] [device ...]\n"
+                            "  CSV (sensor,seq,realtime,C,Pa,status) or with -b struct bmp280_tagged_record\n"
+                            "  to stdout, -n records per sensor (default: until SIGINT), device: " DEVICE_PATH "\n",
+                    argv[0]);
             return EXIT_FAILURE;
         }
+    }
+
+    const char *const *paths = (const char *const *)&argv[optind];
+    int nr_paths = argc - optind;
+    if (nr_paths == 0) {
+        paths = &default_path;
+        nr_paths = 1;
+    }
+
+    if (bmp280_reader_open(&reader, paths, nr_paths) == -1) {
+        perror("Failed to open the sensors");
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER);
 
-        memset(buffer, 0, BUFFER_SIZE);
-        write_timestamp(buffer, BUFFER_SIZE);
+    if (!out.binary)
+        printf("sensor,seq,realtime,temperature_c,pressure_pa,status\n");
 
-        printf("%s: %.2fC\n", buffer, read_buffer/100.0);
-        sleep(SLEEP_DURATION); // Sleep for 1 second
+    while (!done(&reader, &out)) {
+        int n = bmp280_reader_poll(&reader, IDLE_TIMEOUT_MS, write_records, &out);
+        if (n == -1) {
+            perror("Failed to read the sensors");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (n == 0 && !stop) {
+            fprintf(stderr, "no record for %d ms\n", IDLE_TIMEOUT_MS);
+            break;
+        }
     }
+    fflush(stdout);
 
-    close(fd);
+    for (int i = 0; i < reader.nr_sensors; i++) {
+        const struct bmp280_sensor *s = &reader.sensor[i];
+        fprintf(stderr, "%d %s: %llu records in %llu reads (%.1f records/read), %llu lost, %llu repeated\n", i,
+                s->path, (unsigned long long)s->records, (unsigned long long)s->reads,
+                s->reads ? (double)s->records / s->reads : 0.0, (unsigned long long)s->lost,
+                (unsigned long long)s->repeated);
+    }
 
-    // Close the device file
-    close(fd);
-    printf("read /dev/pdev 10 times.\n");
-    return EXIT_SUCCESS;
+    // Closes every device once
+    bmp280_reader_close(&reader);
+    return ret;
 }
@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "bmp280_reader.h"
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// odr_ms of the loaded driver, 0 (single record mode) when it cannot be read
+static unsigned int driver_odr_ms(void) {
+    unsigned int odr_ms = 0;
+    FILE *f = fopen(BMP280_READER_ODR_MS, "r");
+    if (f) {
+        if (fscanf(f, "%u", &odr_ms) != 1)
+            odr_ms = 0;
+        fclose(f);
+    }
+    return odr_ms;
+}
+
+int bmp280_reader_open(struct bmp280_reader *r, const char *const *paths, int n) {
+    if (n < 1 || n > BMP280_READER_MAX_SENSORS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(r->sensor, 0, sizeof(r->sensor));
+    r->nr_sensors = 0;
+    r->single = driver_odr_ms() == 0;
+    for (int i = 0; i < n; i++) {
+        struct bmp280_sensor *s = &r->sensor[i];
+        struct bmp280_settings set;
+        s->path = paths[i];
+        s->fd = open(paths[i], O_RDONLY | O_NONBLOCK);
+        if (s->fd == -1) {
+            int err = errno;
+            bmp280_reader_close(r);
+            errno = err;
+            return -1;
+        }
+        // Without a period (old driver) read once a second
+        s->period_us = ioctl(s->fd, BMP280_IOC_GET_SETTINGS, &set) == 0 && set.period_us ? set.period_us : 1000000;
+        r->nr_sensors++;
+    }
+
+    // Converting every timestamp with localtime() costs more than reading the record,
+    // one offset taken here turns the monotonic kernel timestamps into wall clock time
+    r->realtime_offset_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+    return 0;
+}
+
+// Reads what one device has queued, BMP280_READER_BATCH records at a time
+static int drain(struct bmp280_reader *r, int i, bmp280_records_cb cb, void *arg) {
+    struct bmp280_sensor *s = &r->sensor[i];
+    int delivered = 0;
+
+    for (;;) {
+        ssize_t len = read(s->fd, r->batch, sizeof(r->batch));
+        if (len == -1) {
+            if (errno == EAGAIN || errno == EINTR)
+                return delivered;
+            return -1;
+        }
+        if (len == 0)
+            return delivered;
+
+        size_t got = len / sizeof(r->batch[0]), n = 0;
+        for (size_t j = 0; j < got; j++) {
+            // Records from the cache repeat the seq of their bus read: same sample, drop it
+            if (s->records && r->batch[j].seq == s->last_seq) {
+                s->repeated++;
+                continue;
+            }
+            if (s->records && r->batch[j].seq > s->last_seq + 1)
+                s->lost += r->batch[j].seq - s->last_seq - 1;
+            s->last_seq = r->batch[j].seq;
+            s->records++;
+            r->batch[n++] = r->batch[j];
+        }
+        if (n) {
+            s->reads++;
+            delivered += n;
+            cb(r, i, r->batch, n, arg);
+        }
+
+        // A short read emptied the ring, one record per read() without odr_ms
+        if (got < BMP280_READER_BATCH)
+            return delivered;
+    }
+}
+
+// One poll() over the sensors due: all of them in stream mode, in single record mode those
+// whose period elapsed (the others are skipped with fd -1 and bound the timeout instead)
+static int poll_once(struct bmp280_reader *r, int timeout_ms, bmp280_records_cb cb, void *arg) {
+    struct pollfd pfd[BMP280_READER_MAX_SENSORS];
+    int64_t now = clock_ns(CLOCK_MONOTONIC);
+    int delivered = 0;
+
+    for (int i = 0; i < r->nr_sensors; i++) {
+        struct bmp280_sensor *s = &r->sensor[i];
+        pfd[i].fd = s->fd;
+        pfd[i].events = POLLIN;
+        if (r->single && s->next_ns > now) {
+            int wait_ms = (s->next_ns - now + 999999) / 1000000;
+            pfd[i].fd = -1;
+            if (timeout_ms < 0 || wait_ms < timeout_ms)
+                timeout_ms = wait_ms;
+        }
+    }
+
+    int ready = poll(pfd, r->nr_sensors, timeout_ms);
+    if (ready <= 0)
+        return (ready == -1 && errno == EINTR) ? 0 : ready;
+
+    for (int i = 0; i < r->nr_sensors; i++) {
+        if (pfd[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            errno = ENODEV;
+            return -1;
+        }
+        if (!(pfd[i].revents & POLLIN))
+            continue;
+
+        if (r->single)
+            r->sensor[i].next_ns = now + r->sensor[i].period_us * 1000LL;
+        int ret = drain(r, i, cb, arg);
+        if (ret < 0)
+            return -1;
+        delivered += ret;
+    }
+    return delivered;
+}
+
+int bmp280_reader_poll(struct bmp280_reader *r, int timeout_ms, bmp280_records_cb cb, void *arg) {
+    int64_t deadline = clock_ns(CLOCK_MONOTONIC) + timeout_ms * 1000000LL;
+
+    // Reads which only returned repeated records, or sensors not due yet, are no result
+    for (;;) {
+        int left_ms = -1;
+        if (timeout_ms >= 0) {
+            int64_t left = deadline - clock_ns(CLOCK_MONOTONIC);
+            if (left <= 0)
+                return 0;
+            left_ms = (left + 999999) / 1000000;
+        }
+
+        errno = 0;
+        int ret = poll_once(r, left_ms, cb, arg);
+        if (ret != 0)
+            return ret;
+        if (errno == EINTR)
+            return 0;
+    }
+}
+
+void bmp280_reader_close(struct bmp280_reader *r) {
+    for (int i = 0; i < r->nr_sensors; i++)
+        close(r->sensor[i].fd);
+    r->nr_sensors = 0;
+}
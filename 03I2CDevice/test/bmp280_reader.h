@@ -0,0 +1,71 @@
+#ifndef BMP280_READER_H
+#define BMP280_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../i2c_device.h"
+
+// Reads struct bmp280_record from any number of /dev/bmp280-<bus>-<addr> in one thread:
+// every device is opened once, poll() waits for all of them and each ready device is
+// drained with reads of up to BMP280_READER_BATCH records. With odr_ms > 0 (ring of the
+// driver) one read returns everything queued since the last one. With odr_ms = 0 the
+// device is always readable and every read returns one record (possibly a cached copy,
+// and blocking on a forced conversion despite O_NONBLOCK), so each sensor is read once
+// per measurement period (BMP280_IOC_GET_SETTINGS) instead. In both modes records that
+// repeat the seq of the previous one (cache hits) are dropped, not delivered.
+
+#define BMP280_READER_MAX_SENSORS 16
+#define BMP280_READER_BATCH 256        // Records per read()
+#define BMP280_READER_ODR_MS "/sys/module/i2c_device/parameters/odr_ms"
+
+// Binary stream of several sensors: every record tagged with the index of its device
+struct bmp280_tagged_record {
+    uint32_t sensor;
+    uint32_t reserved;
+    struct bmp280_record rec;
+};
+
+struct bmp280_sensor {
+    const char *path;
+    int fd;
+    uint32_t last_seq;
+    uint64_t records;                  // Records delivered
+    uint64_t lost;                     // Bus reads missing between records (seq gaps)
+    uint64_t reads;                    // read() calls that returned records
+    uint64_t repeated;                 // Records dropped because their seq did not advance
+    uint32_t period_us;                // Single record mode: one read per period
+    int64_t next_ns;                   // Single record mode: CLOCK_MONOTONIC of the next read
+};
+
+struct bmp280_reader {
+    struct bmp280_sensor sensor[BMP280_READER_MAX_SENSORS];
+    int nr_sensors;
+    int single;                        // Driver loaded with odr_ms = 0
+    int64_t realtime_offset_ns;        // CLOCK_REALTIME - CLOCK_MONOTONIC at open
+    struct bmp280_record batch[BMP280_READER_BATCH];
+};
+
+// Called with the records of one read() of one sensor, in order
+typedef void (*bmp280_records_cb)(struct bmp280_reader *r, int sensor,
+                                  const struct bmp280_record *rec, size_t n, void *arg);
+
+// Opens the devices (non-blocking). Returns 0, or -1 with errno set and nothing left open.
+int bmp280_reader_open(struct bmp280_reader *r, const char *const *paths, int n);
+
+// Waits up to timeout_ms (-1: forever) for new records, drains every ready device and passes
+// them to cb. Returns the number of records delivered, 0 on timeout or signal, -1 with
+// errno set on error (a removed sensor reports ENODEV).
+int bmp280_reader_poll(struct bmp280_reader *r, int timeout_ms, bmp280_records_cb cb, void *arg);
+
+void bmp280_reader_close(struct bmp280_reader *r);
+
+// Kernel timestamp (CLOCK_MONOTONIC) of a record as wall clock time, without a syscall
+static inline struct timespec bmp280_reader_realtime(const struct bmp280_reader *r, uint64_t timestamp_ns) {
+    uint64_t ns = timestamp_ns + r->realtime_offset_ns;
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    return ts;
+}
+
+#endif // BMP280_READER_H
@@ -1,21 +1,40 @@
 /************************************************************
- *  char_driver.c - Simple Linux Kernel Pseudo Character Driver
+ *  irq_device.c - Simple Linux Kernel GPIO Interrupt Driver
  *
  *  Description:
- *      This is a basic Linux kernel pseudo character device driver.
- *      The driver implements open, close, read, write, and lseek operations.
+ *      This is a basic Linux kernel gpio interrupt driver.
+ *      Every edge on the input pin is timestamped in the hard
+ *      interrupt handler and handed to user space in batches.
  *      It can be used as a template for developing more complex
- *      character drivers.
+ *      interrupt driven character drivers.
  *
  *  Functionality:
- *      - Registers a character device with the kernel.
- *      - Implements open, release (close), read, write, and lseek operations.
+ *      - Registers a character device (pirq) with the kernel.
+ *      - requests the GPIO of the `pin` module parameter (default 17) as
+ *        input and its interrupt (gpio_to_irq) as a threaded irq on the
+ *        edges of the `edge` module parameter (1 rising, 2 falling, 3 both).
+ *      - the hard handler only timestamps the edge into a lock-free ring
+ *        (single producer: the handler, single consumer: the readers under
+ *        a mutex), the thread handler wakes sleeping readers.
+ *      - read() returns as many struct pirq_event (irq_device.h) as fit
+ *        into the buffer, blocks until the first one unless O_NONBLOCK,
+ *        poll() reports POLLIN while events are queued.
+ *      - edges lost to a full ring or to the rate cap show up as gaps in
+ *        seq and in /sys/class/irqdevclass/pirq/counters/.
+ *      - device number, class, cdev and /dev/pirq come from the shared
+ *        driver core (drv_core.ko, 05DriverCore), as do the per-cpu
+ *        statistics (ops, bytes, errors, log2 latency histogram) of every
+ *        file operation under /sys/class/irqdevclass/pirq/stats/.
+ *      - tunables under /sys/class/irqdevclass/pirq/tuning/:
+ *          coalesce_events  wake readers after this many events ...
+ *          coalesce_us      ... or this long after the first unread event
+ *          debounce_us      ignore edges closer than this to the last one
+ *          max_rate         events per second, the rest is dropped (0: off)
  *
  *  Usage:
  *      - To compile: `make`
- *      - To load: `sudo insmod char_driver.ko`
- *      - To create a device node: `sudo mknod /dev/simple_char c <major> 0`
- *      - To remove: `sudo rmmod char_driver`
+ *      - To load: `sudo insmod drv_core.ko && sudo insmod irq_device.ko pin=17 edge=1`
+ *      - To remove: `sudo rmmod irq_device`
  *
  *  License:
  *      This source code is licensed under the GPL License.
@@ -29,93 +48,320 @@
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/gpio.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
 #include <linux/slab.h>
-#include <linux/i2c.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include "irq_device.h"
+#include "drv_core.h"
 
 /* meta information */
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Kishwar Kumar");
-MODULE_DESCRIPTION("This is a basic Linux kernel drivers for i2c connecting BMP280.");
+MODULE_DESCRIPTION("This is a basic Linux kernel driver for gpio interrupts.");
 
-static int32_t  read_temperature(void);
+#define MODULE_NAME "SINGLE_CHAR_IRQ_DEVICE"
 
-#define MODULE_NAME "SINGLE_CHAR_I2C_DEVICE"
+/* input pin and the edges it interrupts on */
+static int pin = 17;
+module_param(pin, int, 0444);
+MODULE_PARM_DESC(pin, "GPIO number of the input (default 17)");
 
-/* lets store device number */
-dev_t device_number;
+static int edge = IRQF_TRIGGER_RISING;
+module_param(edge, int, 0444);
+MODULE_PARM_DESC(edge, "edges to count: 1 rising, 2 falling, 3 both (default 1)");
 
-/*cdev variable*/
-struct cdev pcdev;
+/* size of the event ring, rounded up to a power of two */
+#define PIRQ_RING_MIN  64
+#define PIRQ_RING_MAX  (1 << 20)
 
-static struct i2c_adapter *bmp_i2c_adapter = NULL;
-static struct i2c_client *bmp280_i2c_client = NULL;
+static unsigned int ring_events = 16384;
+module_param(ring_events, uint, 0444);
+MODULE_PARM_DESC(ring_events, "events buffered between interrupt and read() (64..1048576, default 16384)");
 
-/* Defines for device identification */ 
-#define I2C_BUS_AVAILABLE	1	         	/* The I2C Bus available on the raspberry */
-#define SLAVE_DEVICE_NAME	"BMP280"	  /* Device and Driver Name */
-#define BMP280_SLAVE_ADDRESS	0x76		/* BMP280 I2C address */
+/* device number, class and /dev/pirq from the driver core */
+static struct drv_core pirq_core;
+/*allocated at load, freed by pirq_release with the last reference of the node*/
+static struct drv_core_dev *pirq_dev;
 
-/* Variables for temperature calculation */
-int32_t dig_T1, dig_T2, dig_T3;
+/* limits of the tunables */
+#define PIRQ_COALESCE_US_MAX  1000000
+#define PIRQ_DEBOUNCE_US_MAX  1000000
 
-static const struct i2c_device_id bmp_id[] = {
-  { SLAVE_DEVICE_NAME, 0 }, 
-  { }
+/*
+ * event ring, head and tail are free running event counters, the slot is
+ * (index & (size - 1)). The hard handler is the only writer of tail, seq
+ * and its counters (one irq line never runs on two cpus at once), the
+ * readers under read_lock are the only writers of head.
+ *
+ * coalescing: the handler wakes the readers once coalesce_events events
+ * are queued since the last wake-up, coalesce_timer wakes them
+ * coalesce_us after the first of fewer events.
+ */
+struct pirq_ring
+{
+  struct pirq_event *events;
+  u32 size;
+
+  /*tunables, written from sysfs, read by the handler*/
+  u32 coalesce_events;
+  u32 coalesce_us;
+  u32 debounce_us;
+  u32 max_rate;
+
+  u32 tail ____cacheline_aligned_in_smp;    /*producer: hard handler*/
+  u32 woken;                                /*tail at the last wake-up*/
+  u64 seq;
+  u64 last_ns;                              /*last edge passing the debounce*/
+  u64 rate_window_ns;                       /*start of the current second*/
+  u32 rate_count;                           /*events in the current second*/
+  u64 dropped;                              /*lost to a full ring*/
+  u64 rate_dropped;                         /*lost to max_rate*/
+  u64 debounced;                            /*ignored bounces*/
+  u64 coalesced;                            /*events queued without a wake-up*/
+  atomic_long_t wakeups;                    /*from the thread and the timer*/
+  struct hrtimer coalesce_timer;
+
+  u32 head ____cacheline_aligned_in_smp;    /*consumer: read()*/
+  struct mutex read_lock;
+  wait_queue_head_t readq;
 };
 
-static struct i2c_driver bmp_driver = {
-	.driver = {
-		.name = SLAVE_DEVICE_NAME,
-		.owner = THIS_MODULE
-	}
-};
+static struct pirq_ring pirq_ring;
+static int pirq_irq;
 
-static struct i2c_board_info bmp_i2c_board_info = {
-	I2C_BOARD_INFO(SLAVE_DEVICE_NAME, BMP280_SLAVE_ADDRESS)
-};
+/*
+ * @brief hard interrupt handler, timestamps the edge into the ring
+ * @return IRQ_WAKE_THREAD when readers are due to be woken, IRQ_HANDLED otherwise
+ */
+static irqreturn_t pirq_hard_handler(int irq, void *data)
+{
+  struct pirq_ring *r = data;
+  u64 now = ktime_get_ns();
+  u32 tail = r->tail;
+  u32 head = smp_load_acquire(&r->head);
+  u32 max_rate = READ_ONCE(r->max_rate);
+  u32 coalesce_us;
+
+  /*a bounce is no edge, it takes no seq*/
+  if(now - r->last_ns < (u64)READ_ONCE(r->debounce_us) * NSEC_PER_USEC)
+  {
+    WRITE_ONCE(r->debounced, r->debounced + 1);
+    return IRQ_HANDLED;
+  }
+  r->last_ns = now;
+
+  r->seq++;
+
+  /*over the cap the handler only counts, readers are not woken either*/
+  if(now - r->rate_window_ns >= NSEC_PER_SEC)
+  {
+    r->rate_window_ns = now;
+    r->rate_count = 0;
+  }
+  if(max_rate && ++r->rate_count > max_rate)
+  {
+    WRITE_ONCE(r->rate_dropped, r->rate_dropped + 1);
+    return IRQ_HANDLED;
+  }
+
+  if(tail - head == r->size)
+  {
+    WRITE_ONCE(r->dropped, r->dropped + 1);
+    return IRQ_HANDLED;
+  }
+
+  r->events[tail & (r->size - 1)].timestamp_ns = now;
+  r->events[tail & (r->size - 1)].seq = r->seq;
+
+  /*publish the event, pairs with the load-acquire of the reader*/
+  smp_store_release(&r->tail, tail + 1);
+
+  /*enough events for a wake-up, the waking is left to the thread*/
+  if(tail + 1 - READ_ONCE(r->woken) >= READ_ONCE(r->coalesce_events))
+  {
+    WRITE_ONCE(r->woken, tail + 1);
+    hrtimer_try_to_cancel(&r->coalesce_timer);
+    return wq_has_sleeper(&r->readq) ? IRQ_WAKE_THREAD : IRQ_HANDLED;
+  }
+
+  /*
+   * fewer events: the timer wakes the readers unless more events follow.
+   * A timer whose callback is running is no longer queued and may already
+   * have read tail, it is armed again. The barrier orders the tail store
+   * above before the queued check, pairs with the one in the callback.
+   */
+  WRITE_ONCE(r->coalesced, r->coalesced + 1);
+  coalesce_us = READ_ONCE(r->coalesce_us);
+  smp_mb();
+  if(!hrtimer_is_queued(&r->coalesce_timer))
+    hrtimer_start(&r->coalesce_timer, us_to_ktime(coalesce_us), HRTIMER_MODE_REL_HARD);
+
+  return IRQ_HANDLED;
+}
+
+/*
+ * @brief coalesce_us passed since the first event nobody was woken for
+ */
+static enum hrtimer_restart pirq_coalesce_expired(struct hrtimer *timer)
+{
+  struct pirq_ring *r = container_of(timer, struct pirq_ring, coalesce_timer);
+  u32 tail;
+
+  /*
+   * the timer is dequeued, pairs with the barrier of the handler: an event
+   * published from here on either shows up in tail below or finds the timer
+   * unqueued and arms it again. Events racing with the woken update are
+   * taken into this wake-up.
+   */
+  smp_mb();
+  do
+  {
+    tail = smp_load_acquire(&r->tail);
+    WRITE_ONCE(r->woken, tail);
+    smp_mb();
+  } while(tail != smp_load_acquire(&r->tail));
+
+  if(wq_has_sleeper(&r->readq))
+  {
+    atomic_long_inc(&r->wakeups);
+    wake_up_interruptible_poll(&r->readq, EPOLLIN | EPOLLRDNORM);
+  }
+
+  return HRTIMER_NORESTART;
+}
+
+/*
+ * @brief threaded interrupt handler, wakes the readers
+ */
+static irqreturn_t pirq_thread_handler(int irq, void *data)
+{
+  struct pirq_ring *r = data;
+
+  atomic_long_inc(&r->wakeups);
+  wake_up_interruptible_poll(&r->readq, EPOLLIN | EPOLLRDNORM);
+  return IRQ_HANDLED;
+}
+
+/*
+ * @brief number of events waiting in the ring
+ */
+static u32 pirq_ring_used(struct pirq_ring *r)
+{
+  return smp_load_acquire(&r->tail) - r->head;
+}
+
+/*
+ * @brief copy up to count bytes of whole events to user space.
+ *        caller holds read_lock
+ * @return bytes copied, -EFAULT when nothing could be copied
+ */
+static ssize_t pirq_ring_consume(struct pirq_ring *r, char __user *pbuff, size_t count)
+{
+  u32 head = r->head;
+  u32 n = min_t(size_t, pirq_ring_used(r), count / sizeof(struct pirq_event));
+  u32 off = head & (r->size - 1);
+  u32 first = min(n, r->size - off);
+
+  /*the events may wrap around the end of the ring*/
+  if(copy_to_user(pbuff, &r->events[off], first * sizeof(struct pirq_event)) ||
+     copy_to_user(pbuff + first * sizeof(struct pirq_event), r->events,
+                  (n - first) * sizeof(struct pirq_event)))
+    return -EFAULT;
+
+  /*hand the slots back to the handler*/
+  smp_store_release(&r->head, head + n);
+  return n * sizeof(struct pirq_event);
+}
+
+/*
+ * @brief wait for events unless O_NONBLOCK and consume as many as fit
+ * @return bytes of whole events, negative errno otherwise
+ */
+static ssize_t pirq_read(struct file *pfile, char __user *pbuff, size_t count)
+{
+  struct pirq_ring *r = &pirq_ring;
+  ssize_t ret;
+
+  if(mutex_lock_interruptible(&r->read_lock))
+    return -ERESTARTSYS;
+
+  while(pirq_ring_used(r) == 0)
+  {
+    mutex_unlock(&r->read_lock);
+
+    if(pfile->f_flags & O_NONBLOCK)
+      return -EAGAIN;
+
+    if(wait_event_interruptible(r->readq, pirq_ring_used(r) != 0))
+      return -ERESTARTSYS;
+
+    if(mutex_lock_interruptible(&r->read_lock))
+      return -ERESTARTSYS;
+  }
+
+  ret = pirq_ring_consume(r, pbuff, count);
+  mutex_unlock(&r->read_lock);
+  return ret;
+}
 
 /*-------------------------------------------------------------------*/
 /*define global functions*/
 ssize_t _read(struct file *pfile, char __user *pbuff, size_t count, loff_t *poff)
 {
-  int32_t tmp;
-  int to_copy, not_copied;
+  u64 start;
+  ssize_t ret;
 
-  pr_info("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
+  pr_debug("%s: executing %s, requested %zu bytes\n", MODULE_NAME, __func__, count);
 
-  if(pbuff == NULL || poff == NULL)
+  if(pbuff == NULL || count < sizeof(struct pirq_event))
   {
     pr_err("%s: %s invalid parameters.\n", MODULE_NAME, __func__);
     return -EINVAL;
   }
 
-  /* get temporature */
-  tmp = read_temperature();
-
-  /* get size of data to copy */
-  to_copy = min(count, sizeof(tmp));
-
-  /*copy user data*/
-  not_copied = copy_to_user(pbuff, &tmp, to_copy);
+  start = ktime_get_ns();
+  ret = pirq_read(pfile, pbuff, count);
+  drv_core_account(pirq_dev, DRV_STAT_READ, ret, ktime_get_ns() - start);
+  return ret;
+}
 
-  if(not_copied != 0)
-  {
-    pr_err("%s: %s unable to copy data to user space.\n", MODULE_NAME, __func__);
-    return EFAULT;
-  }
+__poll_t _poll(struct file *pfile, poll_table *wait)
+{
+  struct pirq_ring *r = &pirq_ring;
 
-  return to_copy - not_copied;
+  poll_wait(pfile, &r->readq, wait);
+  return pirq_ring_used(r) ? EPOLLIN | EPOLLRDNORM : 0;
 }
 
 int _open(struct inode *node, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
-  return 0;
+  int ret;
+
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+
+  /*only reading makes sense*/
+  if(pfile->f_mode & FMODE_WRITE)
+    ret = -EINVAL;
+  else
+    ret = stream_open(node, pfile);
+
+  drv_core_account(pirq_dev, DRV_STAT_OPEN, ret, 0);
+  return ret;
 }
 
 int _release(struct inode *pnode, struct file *pfile)
 {
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  pr_debug("%s: executing %s\n", MODULE_NAME, __func__);
+  drv_core_account(pirq_dev, DRV_STAT_RELEASE, 0, 0);
   return 0;
 }
 
@@ -124,160 +370,239 @@ struct file_operations pcfops =
 {
   .open    = _open,
   .read    = _read,
+  .poll    = _poll,
+  .llseek  = no_llseek,
   .release = _release,
   .owner   = THIS_MODULE
 };
 
-struct class *pdclass;
-struct device *pdevice;
+/*
+ * counters under /sys/class/irqdevclass/pirq/counters/: edges seen by the
+ * handler, edges lost to a full ring / to max_rate, ignored bounces, events
+ * queued without a wake-up, wake-ups and events waiting for read()
+ */
+#define PIRQ_COUNTER_ATTR(_name)                                                          \
+  static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+  {                                                                                     \
+    return sysfs_emit(buf, "%llu\n", (u64)READ_ONCE(pirq_ring._name));                  \
+  }                                                                                     \
+  static DEVICE_ATTR_RO(_name)
+
+static ssize_t events_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  return sysfs_emit(buf, "%llu\n", READ_ONCE(pirq_ring.seq));
+}
+static DEVICE_ATTR_RO(events);
+
+PIRQ_COUNTER_ATTR(dropped);
+PIRQ_COUNTER_ATTR(rate_dropped);
+PIRQ_COUNTER_ATTR(debounced);
+PIRQ_COUNTER_ATTR(coalesced);
+
+static ssize_t wakeups_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  return sysfs_emit(buf, "%ld\n", atomic_long_read(&pirq_ring.wakeups));
+}
+static DEVICE_ATTR_RO(wakeups);
+
+static ssize_t queued_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  return sysfs_emit(buf, "%u\n", READ_ONCE(pirq_ring.tail) - READ_ONCE(pirq_ring.head));
+}
+static DEVICE_ATTR_RO(queued);
+
+static struct attribute *pirq_counter_attrs[] =
+{
+  &dev_attr_events.attr,
+  &dev_attr_dropped.attr,
+  &dev_attr_rate_dropped.attr,
+  &dev_attr_debounced.attr,
+  &dev_attr_coalesced.attr,
+  &dev_attr_wakeups.attr,
+  &dev_attr_queued.attr,
+  NULL
+};
+
+static const struct attribute_group pirq_counter_group =
+{
+  .name  = "counters",
+  .attrs = pirq_counter_attrs
+};
+
+/*
+ * tunables under /sys/class/irqdevclass/pirq/tuning/, the handler picks up
+ * a new value with the next edge
+ */
+#define PIRQ_TUNING_ATTR(_name, _min, _max)                                               \
+  static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+  {                                                                                     \
+    return sysfs_emit(buf, "%u\n", READ_ONCE(pirq_ring._name));                         \
+  }                                                                                     \
+  static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,        \
+                               const char *buf, size_t count)                           \
+  {                                                                                     \
+    unsigned int value;                                                                 \
+    int ret = kstrtouint(buf, 0, &value);                                               \
+                                                                                        \
+    if(ret)                                                                             \
+      return ret;                                                                       \
+    if(value < (_min) || value > (_max))                                                \
+      return -EINVAL;                                                                   \
+                                                                                        \
+    WRITE_ONCE(pirq_ring._name, value);                                                 \
+    return count;                                                                       \
+  }                                                                                     \
+  static DEVICE_ATTR_RW(_name)
+
+PIRQ_TUNING_ATTR(coalesce_events, 1, PIRQ_RING_MAX);
+PIRQ_TUNING_ATTR(coalesce_us, 1, PIRQ_COALESCE_US_MAX);
+PIRQ_TUNING_ATTR(debounce_us, 0, PIRQ_DEBOUNCE_US_MAX);
+PIRQ_TUNING_ATTR(max_rate, 0, UINT_MAX);
+
+static struct attribute *pirq_tuning_attrs[] =
+{
+  &dev_attr_coalesce_events.attr,
+  &dev_attr_coalesce_us.attr,
+  &dev_attr_debounce_us.attr,
+  &dev_attr_max_rate.attr,
+  NULL
+};
+
+static const struct attribute_group pirq_tuning_group =
+{
+  .name  = "tuning",
+  .attrs = pirq_tuning_attrs
+};
+
+static const struct attribute_group *pirq_groups[] =
+{
+  &pirq_counter_group,
+  &pirq_tuning_group,
+  &drv_core_stats_group,
+  NULL
+};
 
 /*-------------------------------------------------------------------*/
 /*define static functions*/
-/*-------------------------------------------------------------------*/
-/**
- * @brief Read current temperature from BMP280 sensor
- * @return temperature in degree
+/*
+ * @brief allocate the event ring
+ * @return 0 when OK, negative errno otherwise
  */
-static int32_t  read_temperature(void) {
-	int32_t  var1, var2;
-	int32_t  raw_temp;
-	int32_t  d1, d2, d3;
-
-	/* Read Temperature */
-	d1 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFA);
-	d2 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFB);
-	d3 = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xFC);
-	raw_temp = ((d1<<16) | (d2<<8) | d3) >> 4;
-
-	/* Calculate temperature in degree */
-	var1 = ((((raw_temp >> 3) - (dig_T1 << 1))) * (dig_T2)) >> 11;
-
-	var2 = (((((raw_temp >> 4) - (dig_T1)) * ((raw_temp >> 4) - (dig_T1))) >> 12) * (dig_T3)) >> 14;
-	return ((var1 + var2) *5 +128) >> 8;
+static int pirq_ring_init(struct pirq_ring *r)
+{
+  r->size = roundup_pow_of_two(clamp_t(unsigned int, ring_events, PIRQ_RING_MIN, PIRQ_RING_MAX));
+  r->events = kvcalloc(r->size, sizeof(struct pirq_event), GFP_KERNEL);
+  if(r->events == NULL)
+    return -ENOMEM;
+
+  r->head = r->tail = r->woken = 0;
+  r->seq = 0;
+
+  /*a wake-up per event until tuned*/
+  r->coalesce_events = 1;
+  r->coalesce_us = 1000;
+  r->debounce_us = 0;
+  r->max_rate = 0;
+
+  hrtimer_init(&r->coalesce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+  r->coalesce_timer.function = pirq_coalesce_expired;
+  mutex_init(&r->read_lock);
+  init_waitqueue_head(&r->readq);
+  return 0;
+}
+
+/*
+ * @brief free the node with its last reference: in drv_core_dev_del or,
+ *        with a file still open, at its last close
+ */
+static void pirq_release(struct drv_core_dev *cd)
+{
+  kfree(cd);
 }
 
-/**
+/*
  * @brief this function is called, when the module is loaded into the kernel
  * @return 0 when module init OK, non-zero otherwise
  */
 static int __init ModuleCharacterDeviceInit(void)
 {
-	u8 id;
-  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  int ret;
 
-  /*1. dynamically allocate a device number (creates device number)*/
-  if(alloc_chrdev_region(&device_number, 0 /*first minor*/, 1 /*counts*/, "pdevice") < 0)
-  {
-    pr_err("%s: %s Failed to allocate a major number\n", MODULE_NAME, __func__);
-    return -1;
-  }
-
-  pr_info("%s: %s device number <major>:<minor> = %d:%d\n", MODULE_NAME, __func__,
-                                                      MAJOR(device_number),
-                                                      MINOR(device_number));
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
 
-  /*
-    - The Virtual Filesystem (also known as Virtual Filesystem Switch or VFS) is a
-      kernel software layer that handles all system calls related to a standard Unix
-      filesystem. Its main strength is providing a common interface to several kinds
-      of filesystems.
-
-    - The Virtual File System (VFS) layer [1] provides a uniform interface for the
-      kernel to deal with various I/O requests and specifies a standard interface
-      that each file system must support.
-  */
- 
-  /*2. create device class under /sys/class/ */
-  pdclass = class_create(THIS_MODULE, "pdevclass");
-  if (IS_ERR(pdclass))
+  if(edge < IRQF_TRIGGER_RISING || edge > (IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING))
   {
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to register device class\n", MODULE_NAME, __func__);
-    return PTR_ERR(pdclass);
+    pr_err("%s: %s invalid edge %d\n", MODULE_NAME, __func__, edge);
+    return -EINVAL;
   }
 
-  /*3. Create the device file in /dev and set the permissions to 0666 */
-  pdevice = device_create(pdclass, NULL, device_number, NULL, "pdev");
-  if(pdevice == NULL)
+  /*0. allocate the event ring*/
+  ret = pirq_ring_init(&pirq_ring);
+  if(ret)
   {
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
-    return -1;
+    pr_err("%s: %s Failed to allocate the event ring\n", MODULE_NAME, __func__);
+    return ret;
   }
 
-  /*4. Initialize the character device and add it to the system*/
-  cdev_init(&pcdev, &pcfops);
-  pcdev.owner = THIS_MODULE;
+  /*1. device number and /sys/class/irqdevclass/ from the driver core*/
+  ret = drv_core_register(&pirq_core, THIS_MODULE, "irqdevclass", 1);
+  if(ret)
+    goto err_ring;
 
-  /*5. register a device (cdev structure) with VFS*/  
-  if(cdev_add(&pcdev, device_number, 1) < 0)
+  /*2. Init the input GPIO*/
+  ret = gpio_request_one(pin, GPIOF_IN, "pirq");
+  if(ret)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_err("%s: %s Failed to add the cdev\n", MODULE_NAME, __func__);
-    return -1;
+    pr_err("%s: %s Failed to allocate GPIO %d\n", MODULE_NAME, __func__, pin);
+    goto err_core;
   }
 
-  bmp_i2c_adapter = i2c_get_adapter(I2C_BUS_AVAILABLE);
-  if(bmp_i2c_adapter == NULL)
+  /*3. cdev and /dev/pirq with its sysfs groups*/
+  pirq_dev = kzalloc(sizeof(*pirq_dev), GFP_KERNEL);
+  if(pirq_dev == NULL)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_info("%s: %s unable to get i2c adaptor...\n", MODULE_NAME, __func__);
-    return -1;
+    ret = -ENOMEM;
+    goto err_gpio;
   }
 
-  bmp280_i2c_client = i2c_new_client_device(bmp_i2c_adapter, &bmp_i2c_board_info);
-  if(bmp280_i2c_client == NULL)
+  pirq_dev->release = pirq_release;
+  ret = drv_core_dev_add(&pirq_core, pirq_dev, &pcfops, NULL, NULL, pirq_groups, "pirq");
+  if(ret)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    pr_info("%s: %s unable to get i2c device...\n", MODULE_NAME, __func__);
-    return -1;
+    /*the node took pirq_dev along*/
+    pr_err("%s: %s Failed to create the device\n", MODULE_NAME, __func__);
+    goto err_gpio;
   }
 
-  if(i2c_add_driver(&bmp_driver) == -1)
+  /*4. Route the edges of the pin to the handlers*/
+  pirq_irq = gpio_to_irq(pin);
+  if(pirq_irq < 0)
   {
-    device_destroy(pdclass, device_number);
-    class_destroy(pdclass);
-    unregister_chrdev_region(device_number, 1);
-    i2c_unregister_device(bmp280_i2c_client);
-    pr_info("%s: %s Can't add driver...\n", MODULE_NAME, __func__);
-    return -1;
+    pr_err("%s: %s GPIO %d has no interrupt\n", MODULE_NAME, __func__, pin);
+    ret = pirq_irq;
+    goto err_device;
   }
 
-  pr_info("%s: %s BMP280 Driver added!\n", MODULE_NAME, __func__);
-
-  if (bmp280_i2c_client == NULL)
+  ret = request_threaded_irq(pirq_irq, pirq_hard_handler, pirq_thread_handler, edge, "pirq", &pirq_ring);
+  if(ret)
   {
-    pr_err("%s: %s I2C client not initialized properly\n", MODULE_NAME, __func__);
-    return -ENODEV;
+    pr_err("%s: %s Failed to request irq %d\n", MODULE_NAME, __func__, pirq_irq);
+    goto err_device;
   }
 
-	/* Read Chip ID */
-	id = i2c_smbus_read_byte_data(bmp280_i2c_client, 0xD0);
-	pr_info("%s: %s ID: 0x%x\n", MODULE_NAME, __func__, id);
-
-	/* Read Calibration Values */
-  dig_T1 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x88);
-  dig_T2 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x8a);
-  dig_T3 = i2c_smbus_read_word_data(bmp280_i2c_client, 0x8c);
-
-  if(dig_T2 > 32767) dig_T2 -= 65536;
-
-	if(dig_T3 > 32767) dig_T3 -= 65536;
-
-	/* Initialice the sensor */
-  i2c_smbus_write_byte_data(bmp280_i2c_client, 0xf5, 5<<5);
-  i2c_smbus_write_byte_data(bmp280_i2c_client, 0xf4, ((5<<5) | (5<<2) | (3<<0)));
-
-  pr_info("%s: %s device created successfully..\n", MODULE_NAME, __func__);
-
+  pr_info("%s: %s device created successfully, GPIO %d irq %d, %u events..\n", MODULE_NAME, __func__,
+          pin, pirq_irq, pirq_ring.size);
   return 0;
+
+err_device:
+  drv_core_dev_del(pirq_dev);
+err_gpio:
+  gpio_free(pin);
+err_core:
+  drv_core_unregister(&pirq_core);
+err_ring:
+  kvfree(pirq_ring.events);
+  return ret;
 }
 
 /*
@@ -286,15 +611,14 @@ static int __init ModuleCharacterDeviceInit(void)
 static void __exit ModuleCharacterDeviceExit(void)
 {
   pr_info("%s: executing %s\n", MODULE_NAME, __func__);
-  
+
   /*cleanup task*/
-  i2c_put_adapter(bmp_i2c_adapter);
-  i2c_unregister_device(bmp280_i2c_client);
-	i2c_del_driver(&bmp_driver);
-  device_destroy(pdclass, device_number);
-  class_destroy(pdclass);
-  cdev_del(&pcdev);
-  unregister_chrdev_region(device_number, 1);
+  free_irq(pirq_irq, &pirq_ring);
+  hrtimer_cancel(&pirq_ring.coalesce_timer);
+  drv_core_dev_del(pirq_dev);
+  gpio_free(pin);
+  drv_core_unregister(&pirq_core);
+  kvfree(pirq_ring.events);
 
   pr_info("%s: %s device cleaned up successfully..\n", MODULE_NAME, __func__);
 }
@@ -0,0 +1,32 @@
+/************************************************************
+ *  irq_device.h - Shared definitions of /dev/pirq
+ *
+ *  Description:
+ *      Layout of the records returned by read() on /dev/pirq.
+ *      This header is included by the driver and by user space.
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#ifndef IRQ_DEVICE_H
+#define IRQ_DEVICE_H
+
+#include <linux/types.h>
+
+/*
+ * one edge of the input pin. seq counts every edge seen by the interrupt
+ * handler (bounces inside debounce_us excluded), starting at 1, so a gap
+ * between two records is the number of edges lost to a full ring or to
+ * max_rate.
+ */
+struct pirq_event
+{
+  __u64 timestamp_ns;   /*CLOCK_MONOTONIC, taken in the hard interrupt handler*/
+  __u64 seq;
+};
+
+#endif /* IRQ_DEVICE_H */
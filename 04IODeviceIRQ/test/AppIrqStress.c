@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "../irq_device.h"
+
+#define DEVICE_PATH "/dev/pirq"
+#define BATCH 256              // Events per read()
+#define IDLE_TIMEOUT_MS 1000   // The reader stops after this long without events
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Drain /dev/pirq in batches and check that no edge was lost (seq without gaps)
+static void reader(unsigned long expected) {
+    struct pirq_event ev[BATCH];
+    struct pollfd pfd;
+    unsigned long got = 0, lost = 0, reads = 0;
+    uint64_t last_seq = 0;
+    int fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    if (fd == -1) {
+        perror("reader: failed to open " DEVICE_PATH);
+        exit(EXIT_FAILURE);
+    }
+
+    // Start from an empty ring
+    while (read(fd, ev, sizeof(ev)) > 0)
+        ;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (got < expected && poll(&pfd, 1, IDLE_TIMEOUT_MS) > 0) {
+        ssize_t n = read(fd, ev, sizeof(ev));
+        if (n <= 0)
+            continue;
+        reads++;
+        for (size_t i = 0; i < n / sizeof(ev[0]); i++) {
+            if (last_seq && ev[i].seq != last_seq + 1)
+                lost += ev[i].seq - last_seq - 1;
+            last_seq = ev[i].seq;
+            got++;
+        }
+    }
+
+    printf("reader: %lu of %lu events in %lu reads (%.1f events/read), %lu lost\n", got, expected,
+           reads, reads ? (double)got / reads : 0.0, lost);
+
+    // CPU spent by the reader, tune coalesce_events / coalesce_us to bring it down
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("reader: cpu %.3f s user, %.3f s system\n", ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6,
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+    close(fd);
+    exit(got == expected && lost == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *pull_path;
+    unsigned long edges;
+    double start, seconds;
+    int fd, status;
+    pid_t pid;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <gpio-sim pull attribute> [edges]\n", argv[0]);
+        fprintf(stderr, "e.g. %s /sys/devices/platform/gpio-sim.0/gpiochip2/sim_gpio0/pull 100000\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    pull_path = argv[1];
+    edges = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+
+    fd = open(pull_path, O_WRONLY);
+    if (fd == -1) {
+        perror("Failed to open the gpio-sim pull attribute");
+        return EXIT_FAILURE;
+    }
+    if (pwrite(fd, "pull-down", 9, 0) == -1) {
+        perror("Failed to pull the line down");
+        return EXIT_FAILURE;
+    }
+
+    // irq_device.ko counts rising edges by default: one per pull-down -> pull-up cycle
+    pid = fork();
+    if (pid == 0)
+        reader(edges);
+    if (pid == -1) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    usleep(100000);
+
+    start = now_sec();
+    for (unsigned long i = 0; i < edges; i++) {
+        if (pwrite(fd, "pull-up", 7, 0) == -1 || pwrite(fd, "pull-down", 9, 0) == -1) {
+            perror("Failed to toggle the line");
+            return EXIT_FAILURE;
+        }
+    }
+    seconds = now_sec() - start;
+    close(fd);
+
+    printf("writer: %lu rising edges in %.3f s (%.1f kHz)\n", edges, seconds, edges / seconds / 1e3);
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,331 @@
+/************************************************************
+ *  drv_core.c - Shared character device core of the drivers
+ *
+ *  Description:
+ *      The device number / class / cdev / device node sequence and
+ *      its unwinding, the per-cpu file operation statistics and
+ *      their tracepoint, in one module instead of a copy in every
+ *      driver. char_device, io_device, i2c_device and irq_device
+ *      link against it, so all of them load side by side.
+ *
+ *  Functionality:
+ *      - drv_core_register / drv_core_unregister: a chrdev region of
+ *        `minors` device numbers and /sys/class/<name>/ per driver.
+ *      - drv_core_dev_add / drv_core_dev_del: one device node of a
+ *        driver: lowest free minor, cdev, /dev node with the driver's
+ *        sysfs groups and per-cpu statistics. The node, and through its
+ *        release callback the driver context, lives until the last file
+ *        of it is closed.
+ *      - drv_core_account: one file operation into the statistics of
+ *        the device (ops, bytes, errors, log2 latency histogram, under
+ *        /sys/class/<name>/<dev>/stats/) and the drv_core_op tracepoint.
+ *
+ *  Usage:
+ *      - To compile: `make`
+ *      - To load: `sudo insmod drv_core.ko` before any of the drivers
+ *      - To remove: `sudo rmmod drv_core` after the drivers
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/idr.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/bitops.h>
+
+#include "drv_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "drv_core_trace.h"
+
+/* meta information */
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Kishwar Kumar");
+MODULE_DESCRIPTION("Shared character device core of the drivers.");
+
+#define MODULE_NAME "DRIVER_CORE"
+
+/*-------------------------------------------------------------------*/
+/*define global functions*/
+/*
+ * @brief account one file operation on the local cpu
+ */
+void drv_core_account(struct drv_core_dev *cd, enum drv_stat_op op, ssize_t ret, u64 latency_ns)
+{
+  struct drv_stats *st = get_cpu_ptr(cd->stats);
+
+  u64_stats_update_begin(&st->syncp);
+  u64_stats_inc(&st->ops[op]);
+  if(ret < 0)
+    u64_stats_inc(&st->errors[op]);
+  else
+    u64_stats_add(&st->bytes[op], ret);
+  u64_stats_inc(&st->latency[op][min(fls64(latency_ns), DRV_STAT_LAT_BUCKETS - 1)]);
+  u64_stats_update_end(&st->syncp);
+
+  put_cpu_ptr(cd->stats);
+
+  trace_drv_core_op(cd->dev.devt, op, ret, latency_ns);
+}
+EXPORT_SYMBOL_GPL(drv_core_account);
+
+/*
+ * @brief sum one counter (offset inside struct drv_stats) over all cpus
+ */
+static u64 drv_core_stats_sum(struct drv_core_dev *cd, size_t offset)
+{
+  u64 sum = 0;
+  int cpu;
+
+  for_each_possible_cpu(cpu)
+  {
+    struct drv_stats *st = per_cpu_ptr(cd->stats, cpu);
+    const u64_stats_t *counter = (const u64_stats_t *)((const char *)st + offset);
+    unsigned int seq;
+    u64 value;
+
+    do
+    {
+      seq = u64_stats_fetch_begin(&st->syncp);
+      value = u64_stats_read(counter);
+    } while(u64_stats_fetch_retry(&st->syncp, seq));
+
+    sum += value;
+  }
+
+  return sum;
+}
+
+/*
+ * @brief print the statistics of one op:
+ *        "ops <n>\nbytes <n>\nerrors <n>\nlatency_log2_ns <bucket 0> .. <bucket 31>\n"
+ */
+static ssize_t drv_core_stats_show(struct device *dev, enum drv_stat_op op, char *buf)
+{
+  struct drv_core_dev *cd = dev_get_drvdata(dev);
+  ssize_t len;
+  int k;
+
+  len = sysfs_emit(buf, "ops %llu\nbytes %llu\nerrors %llu\nlatency_log2_ns",
+                   drv_core_stats_sum(cd, offsetof(struct drv_stats, ops) + op * sizeof(u64_stats_t)),
+                   drv_core_stats_sum(cd, offsetof(struct drv_stats, bytes) + op * sizeof(u64_stats_t)),
+                   drv_core_stats_sum(cd, offsetof(struct drv_stats, errors) + op * sizeof(u64_stats_t)));
+
+  for(k = 0; k < DRV_STAT_LAT_BUCKETS; k++)
+    len += sysfs_emit_at(buf, len, " %llu",
+                         drv_core_stats_sum(cd, offsetof(struct drv_stats, latency) +
+                                                (op * DRV_STAT_LAT_BUCKETS + k) * sizeof(u64_stats_t)));
+
+  len += sysfs_emit_at(buf, len, "\n");
+  return len;
+}
+
+#define DRV_CORE_STATS_ATTR(_name, _op)                                                 \
+  static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+  {                                                                                     \
+    return drv_core_stats_show(dev, _op, buf);                                          \
+  }                                                                                     \
+  static DEVICE_ATTR_RO(_name)
+
+DRV_CORE_STATS_ATTR(open, DRV_STAT_OPEN);
+DRV_CORE_STATS_ATTR(read, DRV_STAT_READ);
+DRV_CORE_STATS_ATTR(write, DRV_STAT_WRITE);
+DRV_CORE_STATS_ATTR(release, DRV_STAT_RELEASE);
+
+static struct attribute *drv_core_stats_attrs[] =
+{
+  &dev_attr_open.attr,
+  &dev_attr_read.attr,
+  &dev_attr_write.attr,
+  &dev_attr_release.attr,
+  NULL
+};
+
+const struct attribute_group drv_core_stats_group =
+{
+  .name  = "stats",
+  .attrs = drv_core_stats_attrs
+};
+EXPORT_SYMBOL_GPL(drv_core_stats_group);
+
+/*
+ * @brief allocate minors devt..devt + minors - 1 and create /sys/class/<name>/
+ * @return 0 when OK, negative errno otherwise
+ */
+int drv_core_register(struct drv_core *core, struct module *owner, const char *name, unsigned int minors)
+{
+  int ret;
+
+  core->name = name;
+  core->owner = owner;
+  core->minors = minors;
+  ida_init(&core->ida);
+
+  /*1. dynamically allocate the device numbers*/
+  ret = alloc_chrdev_region(&core->devt, 0 /*first minor*/, minors /*counts*/, name);
+  if(ret < 0)
+  {
+    pr_err("%s: %s %s Failed to allocate a major number\n", MODULE_NAME, __func__, name);
+    return ret;
+  }
+
+  pr_info("%s: %s %s device number <major>:<minor> = %d:%d (%u minors)\n", MODULE_NAME, __func__, name,
+                                                      MAJOR(core->devt),
+                                                      MINOR(core->devt),
+                                                      minors);
+
+  /*2. create device class under /sys/class/ */
+  core->class = class_create(owner, name);
+  if(IS_ERR(core->class))
+  {
+    unregister_chrdev_region(core->devt, minors);
+    pr_err("%s: %s %s Failed to register device class\n", MODULE_NAME, __func__, name);
+    return PTR_ERR(core->class);
+  }
+
+  return 0;
+}
+EXPORT_SYMBOL_GPL(drv_core_register);
+
+/*
+ * @brief undo drv_core_register, after every device is deleted
+ */
+void drv_core_unregister(struct drv_core *core)
+{
+  class_destroy(core->class);
+  unregister_chrdev_region(core->devt, core->minors);
+  ida_destroy(&core->ida);
+}
+EXPORT_SYMBOL_GPL(drv_core_unregister);
+
+/*
+ * @brief last reference of a node: after drv_core_dev_del and the last
+ *        file of the node closed
+ */
+static void drv_core_dev_release(struct device *dev)
+{
+  struct drv_core_dev *cd = container_of(dev, struct drv_core_dev, dev);
+
+  free_percpu(cd->stats);
+  if(cd->release)
+    cd->release(cd);
+}
+
+/*
+ * @brief create one device node: statistics, lowest free minor, cdev and
+ *        /dev/<fmt> with groups under /sys/class/<name>/<fmt>/. The cdev
+ *        is live before the node appears and keeps the device, with it
+ *        cd and the context around it, alive while a file is open
+ * @return 0 when OK, negative errno otherwise. On failure the node is
+ *         dropped as by drv_core_dev_del: cd->release has run
+ */
+int drv_core_dev_add(struct drv_core *core, struct drv_core_dev *cd, const struct file_operations *fops,
+                     struct device *parent, void *priv, const struct attribute_group **groups,
+                     const char *fmt, ...)
+{
+  va_list args;
+  int ret, cpu;
+
+  cd->core = core;
+  cd->priv = priv;
+  cd->stats = NULL;
+
+  /*from here on the device reference owns cd*/
+  device_initialize(&cd->dev);
+  cd->dev.class = core->class;
+  cd->dev.parent = parent;
+  cd->dev.groups = groups;
+  cd->dev.release = drv_core_dev_release;
+  dev_set_drvdata(&cd->dev, cd);
+
+  va_start(args, fmt);
+  ret = kobject_set_name_vargs(&cd->dev.kobj, fmt, args);
+  va_end(args);
+  if(ret)
+    goto err_put;
+
+  cd->stats = alloc_percpu(struct drv_stats);
+  if(cd->stats == NULL)
+  {
+    ret = -ENOMEM;
+    goto err_put;
+  }
+
+  for_each_possible_cpu(cpu)
+    u64_stats_init(&per_cpu_ptr(cd->stats, cpu)->syncp);
+
+  cd->minor = ida_alloc_max(&core->ida, core->minors - 1, GFP_KERNEL);
+  if(cd->minor < 0)
+  {
+    ret = cd->minor;
+    pr_err("%s: %s no minor left for %s\n", MODULE_NAME, __func__, dev_name(&cd->dev));
+    goto err_put;
+  }
+  cd->dev.devt = MKDEV(MAJOR(core->devt), MINOR(core->devt) + cd->minor);
+
+  /*register the cdev with VFS as a child of the device, then the device file in /dev*/
+  cdev_init(&cd->cdev, fops);
+  cd->cdev.owner = core->owner;
+  ret = cdev_device_add(&cd->cdev, &cd->dev);
+  if(ret)
+  {
+    pr_err("%s: %s Failed to add the device %s\n", MODULE_NAME, __func__, dev_name(&cd->dev));
+    goto err_minor;
+  }
+
+  return 0;
+
+err_minor:
+  ida_free(&core->ida, cd->minor);
+err_put:
+  put_device(&cd->dev);
+  return ret;
+}
+EXPORT_SYMBOL_GPL(drv_core_dev_add);
+
+/*
+ * @brief remove the device node and the cdev, new opens fail from here on.
+ *        files already open (and opens racing this) keep the node, its
+ *        statistics and the driver context until they are closed, then
+ *        cd->release runs
+ */
+void drv_core_dev_del(struct drv_core_dev *cd)
+{
+  cdev_device_del(&cd->cdev, &cd->dev);
+  ida_free(&cd->core->ida, cd->minor);
+  put_device(&cd->dev);
+}
+EXPORT_SYMBOL_GPL(drv_core_dev_del);
+
+/*-------------------------------------------------------------------*/
+/*define static functions*/
+/*
+ * @brief this function is called, when the module is loaded into the kernel
+ */
+static int __init ModuleDriverCoreInit(void)
+{
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+  return 0;
+}
+
+/*
+ * @brief this function is called, when the module is removed from the kernel
+ */
+static void __exit ModuleDriverCoreExit(void)
+{
+  pr_info("%s: executing %s\n", MODULE_NAME, __func__);
+}
+
+module_init(ModuleDriverCoreInit);
+module_exit(ModuleDriverCoreExit);
@@ -0,0 +1,114 @@
+/************************************************************
+ *  drv_core.h - Shared character device core of the drivers
+ *
+ *  Description:
+ *      Registration API of drv_core.ko, used by char_device,
+ *      io_device, i2c_device and irq_device. A driver registers
+ *      one struct drv_core (device numbers and its class) and adds
+ *      one struct drv_core_dev per device node (minor, cdev, /dev
+ *      node, per-cpu statistics). Kernel only.
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#ifndef DRV_CORE_H
+#define DRV_CORE_H
+
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/u64_stats_sync.h>
+
+/*
+ * statistics of every file operation, one copy per cpu so that accounting
+ * never touches a shared cache line. latency[op][k] counts the ops which took
+ * [2^(k-1), 2^k) ns (bucket 0: below 1 ns, last bucket: everything above).
+ * errors count every negative return, including -EAGAIN and -ERESTARTSYS.
+ */
+enum drv_stat_op
+{
+  DRV_STAT_OPEN,
+  DRV_STAT_READ,
+  DRV_STAT_WRITE,
+  DRV_STAT_RELEASE,
+  DRV_STAT_OPS
+};
+
+#define DRV_STAT_LAT_BUCKETS 32
+
+struct drv_stats
+{
+  u64_stats_t ops[DRV_STAT_OPS];
+  u64_stats_t bytes[DRV_STAT_OPS];
+  u64_stats_t errors[DRV_STAT_OPS];
+  u64_stats_t latency[DRV_STAT_OPS][DRV_STAT_LAT_BUCKETS];
+  struct u64_stats_sync syncp;
+};
+
+/*
+ * one driver: a range of minors under one major and a class under
+ * /sys/class/<name>/. drv_core_dev_add hands out the lowest free minor.
+ */
+struct drv_core
+{
+  const char *name;                   /*class and chrdev region*/
+  struct module *owner;
+  dev_t devt;                         /*first device number*/
+  unsigned int minors;
+  struct class *class;
+  struct ida ida;                     /*minors in use*/
+};
+
+/*
+ * one device node, embedded in the context of the driver. The device's
+ * drvdata is this struct, drv_core_get_drvdata() returns the context the
+ * driver passed to drv_core_dev_add.
+ *
+ * the cdev holds a reference on the device, and every open file one on the
+ * cdev, so the node lives until drv_core_dev_del and the last file of it
+ * are gone. release, set before drv_core_dev_add, is called then and frees
+ * the context. The embedded device is refcounted, so the context is always
+ * allocated, never static, and every driver sets release.
+ */
+struct drv_core_dev
+{
+  struct drv_core *core;
+  struct cdev cdev;
+  struct device dev;
+  int minor;
+  void *priv;
+  struct drv_stats __percpu *stats;
+  void (*release)(struct drv_core_dev *cd);
+};
+
+/* stats/ of a device: open, read, write, release, list it in the groups of drv_core_dev_add */
+extern const struct attribute_group drv_core_stats_group;
+
+int drv_core_register(struct drv_core *core, struct module *owner, const char *name, unsigned int minors);
+void drv_core_unregister(struct drv_core *core);
+
+__printf(7, 8)
+int drv_core_dev_add(struct drv_core *core, struct drv_core_dev *cd, const struct file_operations *fops,
+                     struct device *parent, void *priv, const struct attribute_group **groups,
+                     const char *fmt, ...);
+void drv_core_dev_del(struct drv_core_dev *cd);
+
+void drv_core_account(struct drv_core_dev *cd, enum drv_stat_op op, ssize_t ret, u64 latency_ns);
+
+/*
+ * @brief context of the driver behind a device of drv_core_dev_add, for
+ *        sysfs attributes
+ */
+static inline void *drv_core_get_drvdata(struct device *dev)
+{
+  struct drv_core_dev *cd = dev_get_drvdata(dev);
+
+  return cd->priv;
+}
+
+#endif /* DRV_CORE_H */
@@ -0,0 +1,63 @@
+/************************************************************
+ *  drv_core_trace.h - Tracepoint of the shared driver core
+ *
+ *  Description:
+ *      One event per file operation accounted by drv_core_account,
+ *      the same for every driver on the core. The drivers keep their
+ *      own tracepoints for the payload (levels, samples, ..).
+ *      It costs a static branch when disabled.
+ *
+ *  Usage:
+ *      - trace-cmd record -e drv_core
+ *      - perf record -e 'drv_core:*'
+ *
+ *  License:
+ *      This source code is licensed under the GPL License.
+ *
+ *  Author:
+ *      Your Name (kumar.kishwar@gmail.com)
+ *      Date: October 2024
+ ************************************************************/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM drv_core
+
+#if !defined(_DRV_CORE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DRV_CORE_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/kdev_t.h>
+
+TRACE_EVENT(drv_core_op,
+
+  TP_PROTO(dev_t devt, int op, ssize_t ret, u64 latency_ns),
+
+  TP_ARGS(devt, op, ret, latency_ns),
+
+  TP_STRUCT__entry(
+    __field(dev_t, devt)
+    __field(int, op)
+    __field(ssize_t, ret)
+    __field(u64, latency_ns)
+  ),
+
+  TP_fast_assign(
+    __entry->devt = devt;
+    __entry->op = op;
+    __entry->ret = ret;
+    __entry->latency_ns = latency_ns;
+  ),
+
+  TP_printk("dev=%d:%d op=%s ret=%zd latency_ns=%llu",
+            MAJOR(__entry->devt), MINOR(__entry->devt),
+            __print_symbolic(__entry->op, { 0, "open" }, { 1, "read" }, { 2, "write" }, { 3, "release" }),
+            __entry->ret, __entry->latency_ns)
+);
+
+#endif /* _DRV_CORE_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE drv_core_trace
+#include <trace/define_trace.h>